@@ -41,20 +41,15 @@ if __name__ == "__main__":
     ntriang, nvec, npts = the_mesh.vectors.shape
     size_reduc_factor = 500.0  # to get a realistic room size (not 3km)
 
-    # create one wall per triangle
-    walls = []
-    for w in range(ntriang):
-        walls.append(
-            pra.wall_factory(
-                the_mesh.vectors[w].T / size_reduc_factor,
-                material.energy_absorption["coeffs"],
-                material.scattering["coeffs"],
-            )
-        )
+    # the triangles are given to the engine as arrays, it builds the walls
+    vertices = the_mesh.vectors.reshape((-1, npts)).T / size_reduc_factor
+    faces = np.arange(ntriang * nvec).reshape((ntriang, nvec))
 
     room = (
-        pra.Room(
-            walls,
+        pra.Room.from_mesh(
+            vertices,
+            faces,
+            materials=material,
             fs=16000,
             max_order=3,
             ray_tracing=True,
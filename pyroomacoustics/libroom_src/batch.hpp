@@ -0,0 +1,297 @@
+/*
+ * Simulation of many shoebox rooms at once
+ * Copyright (C) 2019  Robin Scheibler, Cyril Cadoux
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * You should have received a copy of the MIT License along with this program. If
+ * not, see <https://opensource.org/licenses/MIT>.
+ */
+#ifndef __BATCH_HPP__
+#define __BATCH_HPP__
+
+#include <vector>
+#include <cmath>
+#include <complex>
+#include <algorithm>
+#include <stdexcept>
+#include <Eigen/Dense>
+#include <unsupported/Eigen/FFT>
+
+#include "common.hpp"
+#include "room.hpp"
+#include "diffuse_tail.hpp"
+#include "parallel.hpp"
+
+inline void band_filter(
+    Eigen::Ref<RowArrayXXd> response,
+    int row,
+    const std::vector<std::complex<double>> &spectrum,
+    int nfft,
+    int half,
+    Eigen::FFT<double> &fft,
+    std::vector<double> &block,
+    std::vector<std::complex<double>> &product
+    )
+{
+  /*
+   * Filters a row of response in place, the same as fftconvolve with mode
+   * 'same'. The spectrum of the filter is computed beforehand with nfft
+   * points and the scaling of the inverse FFT, half is the center of the
+   * filter.
+   */
+  int length = response.cols();
+  int n_freq = nfft / 2 + 1;
+
+  std::fill(block.begin(), block.end(), 0.);
+  for (int k = 0 ; k < length ; k++)
+    block[k] = response.coeff(row, k);
+  fft.fwd(&product[0], &block[0], nfft);
+
+  for (int f = 0 ; f < n_freq ; f++)
+    product[f] *= spectrum[f];
+  fft.inv(&block[0], &product[0], nfft);
+
+  for (int k = 0 ; k < length ; k++)
+    response.coeffRef(row, k) = block[half + k];
+}
+
+template<size_t D>
+void shoebox_rir_batch(
+    const RowArrayXXf &room_sizes,
+    const RowArrayXXf &absorption,
+    const RowArrayXXf &scattering,
+    const RowArrayXXf &sources,
+    const RowArrayXXf &mics,
+    int max_order,
+    double fs,
+    double c,
+    int fdl,
+    const RowArrayXXd &filters,
+    const Eigen::ArrayXd &gains,
+    const Eigen::ArrayXd &air_absorption,
+    size_t n_rays,
+    float energy_thres,
+    float time_thres,
+    float receiver_radius,
+    int hist_bin_samples,
+    unsigned int seed,
+    Eigen::Ref<RowArrayXXd> out,
+    int lut_gran,
+    int n_threads
+    )
+{
+  /*
+   * Builds the impulse responses of many shoebox rooms, each with one source
+   * and the same number of microphones, into a buffer allocated by the
+   * caller. The steps are the ones of Room.compute_rir.
+   *
+   * Every room is a task handed out to the threads as they become free, so
+   * that the cores stay busy when the rooms have very different sizes. In a
+   * task, the room is built, the image source part of its responses is
+   * computed with shoebox_rir, without storing the image sources, and the
+   * rays are traced from the source. The diffuse tails are synthesized from
+   * the histograms and added to the bands, the air absorption is applied
+   * and the bands are summed. The images whose filter does not fit in the
+   * responses, and the parts of the tails after the end, are left out.
+   *
+   * With several bands, the image source part of every band and the tails
+   * are filtered by the filter of the band. With a single band, the
+   * response is split in the bands of the filters only when there is air
+   * absorption.
+   *
+   * room_sizes: n_rooms x D
+   * absorption: n_rooms x (n_bands * 2D), the energy absorption of the walls
+   *   of every room, band after band, in the order of the shoebox walls
+   * scattering: n_rooms x (n_bands * 2D), the scattering of the walls, as
+   *   the absorption
+   * sources: n_rooms x D
+   * mics: n_rooms x (D * n_mics), the coordinates of the microphones of
+   *   every room, coordinate after coordinate
+   * max_order: the maximum order of the image sources
+   * fs: the sampling frequency
+   * c: the speed of sound
+   * fdl: the length of the fractional delay filter (odd)
+   * filters: the octave band filters, n_filters x filter length, one per
+   *   band with several bands, none or any number with a single band
+   * gains: the gain of the tail of every band
+   * air_absorption: the air absorption coefficient of every filter, empty
+   *   without air absorption
+   * n_rays: the number of rays, 0 means that there is no ray tracing
+   * energy_thres, time_thres, receiver_radius: the parameters of the ray
+   *   tracing
+   * hist_bin_samples: the number of samples in a bin of the histograms
+   * seed: the seed of the random sequences of the tails
+   * out: n_rooms x (n_mics * length), the responses of every room,
+   *   microphone after microphone
+   * lut_gran: the number of point per unit in the sinc interpolation table
+   * n_threads: the number of threads, 0 means all the cores
+   */
+  int n_rooms = room_sizes.rows();
+
+  if (room_sizes.cols() != int(D) || sources.cols() != int(D))
+    throw std::runtime_error("Error: The room sizes and the sources should have one coordinate per dimension");
+  if (absorption.rows() != n_rooms || scattering.rows() != n_rooms || sources.rows() != n_rooms
+      || mics.rows() != n_rooms || out.rows() != n_rooms)
+    throw std::runtime_error("Error: There should be as many absorptions, scatterings, sources, microphones and responses as rooms");
+  if (absorption.cols() == 0 || absorption.cols() % (2 * D) != 0)
+    throw std::runtime_error("Error: There should be one absorption coefficient per wall and band");
+  if (scattering.cols() != absorption.cols())
+    throw std::runtime_error("Error: There should be one scattering coefficient per wall and band");
+  if (mics.cols() == 0 || mics.cols() % D != 0)
+    throw std::runtime_error("Error: There should be one coordinate per dimension for every microphone");
+
+  int n_bands = absorption.cols() / (2 * D);
+  int n_mics = mics.cols() / D;
+  int n_filters = filters.rows();
+
+  if (n_bands > 1 && n_filters != n_bands)
+    throw std::runtime_error("Error: There should be one filter per band");
+  if (gains.size() != n_bands)
+    throw std::runtime_error("Error: There should be one gain per band");
+  if (air_absorption.size() != 0 && (n_filters == 0 || air_absorption.size() != n_filters))
+    throw std::runtime_error("Error: There should be one air absorption coefficient per filter");
+  if (n_rays > 0 && hist_bin_samples < 1)
+    throw std::runtime_error("Error: The histogram bins should have at least one sample");
+
+  if (out.cols() % n_mics != 0)
+    throw std::runtime_error("Error: The responses should have the same length for every microphone");
+  int length = out.cols() / n_mics;
+  int fdl2 = fdl / 2;
+
+  // the tails start after the delay of the fractional delay filter, with a
+  // whole number of bins
+  int tail_length = 0;
+  if (n_rays > 0 && length > fdl)
+    tail_length = (length - fdl) / hist_bin_samples * hist_bin_samples;
+
+  // the band filtering is done in one FFT, the spectra of the filters are
+  // computed once with the scaling of the inverse FFT
+  bool filtering = n_bands > 1 || air_absorption.size() > 0;
+  int filter_len = filters.cols();
+  int half = (filter_len - 1) / 2;  // the center of the filters, as fftconvolve with mode 'same'
+  int nfft = 2;
+  while (filtering && nfft < length + filter_len - 1)
+    nfft *= 2;
+  int n_freq = nfft / 2 + 1;
+
+  std::vector<std::vector<std::complex<double>>> filter_spectra;
+  if (filtering)
+  {
+    Eigen::FFT<double> fft;
+    fft.SetFlag(fft.HalfSpectrum);
+    std::vector<double> block(nfft, 0.);
+    filter_spectra.resize(n_filters, std::vector<std::complex<double>>(n_freq));
+    for (int b = 0 ; b < n_filters ; b++)
+    {
+      for (int k = 0 ; k < filter_len ; k++)
+        block[k] = filters.coeff(b, k) / nfft;
+      fft.fwd(&filter_spectra[b][0], &block[0], nfft);
+    }
+  }
+
+  // the tails of a single band are split with the rest of the response
+  RowArrayXXd tail_filters = n_bands > 1 ? filters : RowArrayXXd();
+
+  parallel_for(n_rooms, n_threads,
+      [&](size_t r)
+      {
+        Vectorf<D> size = room_sizes.row(r).transpose();
+        Vectorf<D> source = sources.row(r).transpose();
+
+        if ((source.array() < 0.f).any() || (source.array() > size.array()).any())
+          throw std::runtime_error("Error: A source is outside of its room");
+
+        Eigen::Array<float,Eigen::Dynamic,2*D> room_absorption = Eigen::Map<
+          const Eigen::Array<float,Eigen::Dynamic,2*D,Eigen::RowMajor>>(
+              absorption.row(r).data(), n_bands, 2 * D);
+        Eigen::Array<float,Eigen::Dynamic,2*D> room_scattering = Eigen::Map<
+          const Eigen::Array<float,Eigen::Dynamic,2*D,Eigen::RowMajor>>(
+              scattering.row(r).data(), n_bands, 2 * D);
+
+        Room<D> room(size, room_absorption, room_scattering, std::vector<Microphone<D>>(),
+            c, max_order, energy_thres, time_thres, receiver_radius,
+            hist_bin_samples / fs, n_rays > 0);
+
+        Eigen::Map<const Eigen::Matrix<float,D,Eigen::Dynamic,Eigen::RowMajor>> room_mics(
+            mics.row(r).data(), D, n_mics);
+        for (int m = 0 ; m < n_mics ; m++)
+          room.add_mic(room_mics.col(m));
+
+        // the rows of images that are too far from all the microphones are skipped
+        room.set_ism_max_distance(c * length / fs);
+
+        std::vector<RowArrayXXd> rirs = room.shoebox_rir(source, fs, c, fdl, lut_gran, length);
+
+        Eigen::FFT<double> fft;
+        fft.SetFlag(fft.HalfSpectrum);
+        fft.SetFlag(fft.Unscaled);
+        std::vector<double> block(nfft);
+        std::vector<std::complex<double>> product(n_freq);
+
+        if (n_bands > 1)
+          for (int m = 0 ; m < n_mics ; m++)
+            for (int b = 0 ; b < n_bands ; b++)
+              band_filter(rirs[m], b, filter_spectra[b], nfft, half, fft, block, product);
+
+        if (tail_length > 0)
+        {
+          // the histograms of all the microphones, n_bands rows each
+          RowArrayXXf hists = room.ray_tracing_sources(n_rays, source);
+
+          std::vector<RowArrayXXf> histograms(n_mics);
+          for (int m = 0 ; m < n_mics ; m++)
+            histograms[m] = hists.middleRows(m * n_bands, n_bands);
+
+          // every room has its own random sequences
+          std::vector<RowArrayXXd> tails = build_diffuse_tails(
+              histograms, std::vector<int>(n_mics, tail_length), tail_filters, gains,
+              hist_bin_samples, size.prod(), c, fs, seed + (unsigned int)r, 1, 10000.);
+
+          for (int m = 0 ; m < n_mics ; m++)
+            rirs[m].middleCols(fdl2, tail_length) += tails[m];
+        }
+
+        for (int m = 0 ; m < n_mics ; m++)
+        {
+          auto response = out.row(r).segment(m * length, length);
+
+          if (air_absorption.size() == 0)
+          {
+            response = rirs[m].colwise().sum();
+            continue;
+          }
+
+          // a single band is split in the bands of the filters
+          RowArrayXXd bands = n_bands > 1 ? rirs[m] : rirs[m].replicate(n_filters, 1);
+          for (int b = 0 ; n_bands == 1 && b < n_filters ; b++)
+            band_filter(bands, b, filter_spectra[b], nfft, half, fft, block, product);
+
+          // the decay of the air absorption with the distance travelled
+          for (int b = 0 ; b < n_filters ; b++)
+            for (int k = 0 ; k < length - fdl ; k++)
+              bands.coeffRef(b, fdl2 + k) *= exp(-0.5 * air_absorption.coeff(b) * k / fs * c);
+
+          response = bands.colwise().sum();
+        }
+      }
+      );
+}
+
+#endif // __BATCH_HPP__
@@ -0,0 +1,289 @@
+/*
+ * Beams of the image sources used to prune the image source model
+ * Copyright (C) 2019  Robin Scheibler, Cyril Cadoux
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * You should have received a copy of the MIT License along with this program. If
+ * not, see <https://opensource.org/licenses/MIT>.
+ */
+#ifndef __BEAM_HPP__
+#define __BEAM_HPP__
+
+#include <vector>
+#include <algorithm>
+#include <Eigen/Dense>
+
+#include "common.hpp"
+#include "wall.hpp"
+
+template<size_t D>
+class Beam
+{
+  /*
+   * The beam of an image source is the region of space reached by the rays
+   * from the image source that go through its aperture. The aperture is a
+   * convex polygon (3D) or a segment (2D) on the generating wall of the
+   * image source that contains all the reflection points of the paths
+   * going through the image source.
+   *
+   * The beam is stored as a list of half-spaces: the side of the generating
+   * wall opposite to the image source, and one half-space per edge (3D) or
+   * end point (2D) of the aperture. The half-spaces are widened by a small
+   * tolerance so that the tests never exclude a point that is in the beam.
+   *
+   * A beam without half-spaces, e.g. the one of the real source, contains
+   * all the space.
+   *
+   * The same half-spaces with the side of the wall of the apex instead give
+   * the pyramid between the apex and the aperture, which is used for the
+   * visibility of the receivers from the patches of the walls.
+   */
+  std::vector<Vectorf<D>> normals;
+  std::vector<float> offsets;  // a point p is inside if normal.dot(p) - offset >= -tol
+  float tol = 0.f;
+
+  void add_half_space(const Vectorf<D> &normal, float offset)
+  {
+    normals.push_back(normal);
+    offsets.push_back(offset);
+  }
+
+  public:
+    std::vector<Vectorf<D>> aperture;
+
+    void clear()
+    {
+      normals.clear();
+      offsets.clear();
+      aperture.clear();
+    }
+
+    // Computes the half-spaces of the beam of an image source given the
+    // aperture, which should be set first. When beyond is false, the region
+    // between the apex and the aperture is built instead
+    void build(const Vectorf<D> &apex, const Wall<D> &wall, float _tol, bool beyond = true);
+
+    bool contains(const Vectorf<D> &p) const
+    {
+      for (size_t i = 0 ; i < normals.size() ; i++)
+        if (normals[i].dot(p) - offsets[i] < -tol)
+          return false;
+      return true;
+    }
+
+    // Intersection of a convex polygon (3D) or a segment (2D) with the beam,
+    // returns false if it is empty
+    bool clip(
+        const std::vector<Vectorf<D>> &polygon,
+        std::vector<Vectorf<D>> &out,
+        std::vector<Vectorf<D>> &buffer
+        ) const;
+};
+
+template<size_t D>
+std::vector<Vectorf<D>> wall_hull(const Wall<D> &wall)
+{
+  /*
+   * The corners of the convex hull of a wall, in order. The 2D walls are
+   * segments and are returned as is.
+   */
+  std::vector<Vectorf<D>> hull;
+
+  if (D == 2)
+  {
+    for (int c = 0 ; c < wall.corners.cols() ; c++)
+      hull.push_back(wall.corners.col(c));
+    return hull;
+  }
+
+  // Monotone chain on the flat corners of the wall
+  std::vector<Eigen::Vector2f> pts;
+  for (int c = 0 ; c < wall.flat_corners.cols() ; c++)
+    pts.push_back(wall.flat_corners.col(c));
+
+  std::sort(pts.begin(), pts.end(),
+      [](const Eigen::Vector2f &a, const Eigen::Vector2f &b)
+      {
+        return a[0] < b[0] || (a[0] == b[0] && a[1] < b[1]);
+      }
+      );
+
+  auto cross = [](const Eigen::Vector2f &o, const Eigen::Vector2f &a, const Eigen::Vector2f &b)
+  {
+    return (a[0] - o[0]) * (b[1] - o[1]) - (a[1] - o[1]) * (b[0] - o[0]);
+  };
+
+  std::vector<Eigen::Vector2f> flat(2 * pts.size());
+  size_t k = 0;
+  for (size_t i = 0 ; i < pts.size() ; i++)  // lower hull
+  {
+    while (k >= 2 && cross(flat[k-2], flat[k-1], pts[i]) <= 0)
+      k--;
+    flat[k++] = pts[i];
+  }
+  for (size_t i = pts.size() - 1, t = k + 1 ; i > 0 ; i--)  // upper hull
+  {
+    while (k >= t && cross(flat[k-2], flat[k-1], pts[i-1]) <= 0)
+      k--;
+    flat[k++] = pts[i-1];
+  }
+
+  for (size_t i = 0 ; i + 1 < k ; i++)  // the last point is the first one
+    hull.push_back(wall.origin + wall.basis * flat[i]);
+
+  return hull;
+}
+
+template<>
+inline void Beam<2>::build(const Vectorf<2> &apex, const Wall<2> &wall, float _tol, bool beyond)
+{
+  tol = _tol;
+  normals.clear();
+  offsets.clear();
+
+  // the side of the wall opposite to the image source, or the one of the apex
+  Vectorf<2> n = wall.normal.normalized();
+  float offset = n.dot(wall.origin);
+  if ((n.dot(apex) - offset > 0.f) == beyond)
+    add_half_space(-n, -offset);
+  else
+    add_half_space(n, offset);
+
+  // the lines from the image source through the end points of the aperture
+  for (size_t i = 0 ; i < 2 ; i++)
+  {
+    Vectorf<2> u = aperture[i] - apex;
+    Vectorf<2> side(-u[1], u[0]);
+
+    // the other end point is inside
+    if (side.dot(aperture[1 - i] - apex) < 0.f)
+      side = -side;
+
+    float norm = side.norm();
+    if (norm > libroom_eps)
+    {
+      side /= norm;
+      add_half_space(side, side.dot(apex));
+    }
+  }
+}
+
+template<>
+inline void Beam<3>::build(const Vectorf<3> &apex, const Wall<3> &wall, float _tol, bool beyond)
+{
+  tol = _tol;
+  normals.clear();
+  offsets.clear();
+
+  // the side of the wall opposite to the image source, or the one of the apex
+  Vectorf<3> n = wall.normal.normalized();
+  float offset = n.dot(wall.origin);
+  if ((n.dot(apex) - offset > 0.f) == beyond)
+    add_half_space(-n, -offset);
+  else
+    add_half_space(n, offset);
+
+  // the planes through the image source and the edges of the aperture
+  Vectorf<3> center = Vectorf<3>::Zero();
+  for (auto &p : aperture)
+    center += p;
+  center /= aperture.size();
+
+  for (size_t i = 0 ; i < aperture.size() ; i++)
+  {
+    const Vectorf<3> &a = aperture[i];
+    const Vectorf<3> &b = aperture[(i + 1) % aperture.size()];
+    Vectorf<3> side = (a - apex).cross(b - apex);
+
+    // the center of the aperture is inside
+    if (side.dot(center - apex) < 0.f)
+      side = -side;
+
+    // degenerated edges are skipped, which only makes the beam larger
+    float norm = side.norm();
+    if (norm > libroom_eps)
+    {
+      side /= norm;
+      add_half_space(side, side.dot(apex));
+    }
+  }
+}
+
+template<>
+inline bool Beam<2>::clip(
+    const std::vector<Vectorf<2>> &polygon,
+    std::vector<Vectorf<2>> &out,
+    std::vector<Vectorf<2>> &
+    ) const
+{
+  out = polygon;
+
+  for (size_t i = 0 ; i < normals.size() ; i++)
+  {
+    float d0 = normals[i].dot(out[0]) - offsets[i] + tol;
+    float d1 = normals[i].dot(out[1]) - offsets[i] + tol;
+
+    if (d0 < 0.f && d1 < 0.f)
+      return false;
+    else if (d0 < 0.f)
+      out[0] += (out[1] - out[0]) * (d0 / (d0 - d1));
+    else if (d1 < 0.f)
+      out[1] += (out[0] - out[1]) * (d1 / (d1 - d0));
+  }
+
+  return true;
+}
+
+template<>
+inline bool Beam<3>::clip(
+    const std::vector<Vectorf<3>> &polygon,
+    std::vector<Vectorf<3>> &out,
+    std::vector<Vectorf<3>> &buffer
+    ) const
+{
+  // Sutherland-Hodgman algorithm
+  out = polygon;
+
+  for (size_t i = 0 ; i < normals.size() ; i++)
+  {
+    buffer.clear();
+
+    for (size_t j = 0 ; j < out.size() ; j++)
+    {
+      const Vectorf<3> &cur = out[j];
+      const Vectorf<3> &next = out[(j + 1) % out.size()];
+      float d_cur = normals[i].dot(cur) - offsets[i] + tol;
+      float d_next = normals[i].dot(next) - offsets[i] + tol;
+
+      if (d_cur >= 0.f)
+        buffer.push_back(cur);
+      if ((d_cur >= 0.f) != (d_next >= 0.f))
+        buffer.push_back(cur + (next - cur) * (d_cur / (d_cur - d_next)));
+    }
+
+    std::swap(out, buffer);
+    if (out.size() == 0)
+      return false;
+  }
+
+  return true;
+}
+
+#endif // __BEAM_HPP__
@@ -0,0 +1,297 @@
+/*
+ * Bounding volume hierarchies over the walls and receivers of a room
+ * Copyright (C) 2019  Robin Scheibler, Cyril Cadoux
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * You should have received a copy of the MIT License along with this program. If
+ * not, see <https://opensource.org/licenses/MIT>.
+ */
+#ifndef __BVH_HPP__
+#define __BVH_HPP__
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <Eigen/Dense>
+
+#include "common.hpp"
+#include "wall.hpp"
+
+template<size_t D>
+class BVH
+{
+  /*
+   * A bounding volume hierarchy of axis aligned boxes.
+   *
+   * It is used to find the objects (walls, receivers) that a line segment
+   * might intersect without testing all of them. The boxes are provided by
+   * the caller and should be padded so that every object of interest is
+   * visited by the traversal.
+   */
+  struct Node
+  {
+    Vectorf<D> box_min, box_max;
+    int first;  // first index in ids (leaves only)
+    int count;  // number of objects in the leaf, zero for internal nodes
+    int right;  // index of the right child, the left child is the next node
+  };
+
+  static const int leaf_size = 2;
+  static const int linear_scan_size = 16;  // below this, a single leaf holds all the objects
+  static const int max_depth = 64;
+
+  std::vector<Node> nodes;
+  std::vector<int> ids;  // objects sorted so that every leaf is a contiguous range
+  float pad = 0.f;  // largest padding of the boxes, used to extend the segments
+
+  int build_node(
+      int first,
+      int count,
+      const std::vector<Vectorf<D>> &w_min,
+      const std::vector<Vectorf<D>> &w_max
+      )
+  {
+    int index = nodes.size();
+    nodes.push_back(Node());
+
+    Vectorf<D> box_min = w_min[ids[first]];
+    Vectorf<D> box_max = w_max[ids[first]];
+    Vectorf<D> c_min = 0.5f * (box_min + box_max);
+    Vectorf<D> c_max = c_min;
+    for (int i = first + 1 ; i < first + count ; i++)
+    {
+      int w = ids[i];
+      box_min = box_min.cwiseMin(w_min[w]);
+      box_max = box_max.cwiseMax(w_max[w]);
+      Vectorf<D> center = 0.5f * (w_min[w] + w_max[w]);
+      c_min = c_min.cwiseMin(center);
+      c_max = c_max.cwiseMax(center);
+    }
+
+    nodes[index].box_min = box_min;
+    nodes[index].box_max = box_max;
+
+    if (count <= leaf_size || int(ids.size()) <= linear_scan_size)
+    {
+      nodes[index].first = first;
+      nodes[index].count = count;
+      nodes[index].right = -1;
+      return index;
+    }
+
+    // split at the median of the centers along the largest dimension
+    int axis;
+    (c_max - c_min).maxCoeff(&axis);
+    auto begin = ids.begin() + first;
+    std::nth_element(begin, begin + count / 2, begin + count,
+        [&](int a, int b)
+        {
+          float ca = w_min[a][axis] + w_max[a][axis];
+          float cb = w_min[b][axis] + w_max[b][axis];
+          return ca < cb || (ca == cb && a < b);
+        }
+        );
+
+    build_node(first, count / 2, w_min, w_max);
+    int right = build_node(first + count / 2, count - count / 2, w_min, w_max);
+
+    nodes[index].first = first;
+    nodes[index].count = 0;
+    nodes[index].right = right;
+
+    return index;
+  }
+
+  bool segment_box(
+      const Node &node,
+      const Vectorf<D> &start,
+      const Vectorf<D> &dir,
+      float t_pad,
+      float &t_enter
+      ) const
+  {
+    // slab test of the segment start + t * dir, t in [-t_pad, 1 + t_pad]
+    float t_min = -t_pad, t_max = 1.f + t_pad;
+    for (size_t d = 0 ; d < D ; d++)
+    {
+      if (std::abs(dir[d]) < std::numeric_limits<float>::epsilon())
+      {
+        if (start[d] < node.box_min[d] || node.box_max[d] < start[d])
+          return false;
+        continue;
+      }
+
+      float t0 = (node.box_min[d] - start[d]) / dir[d];
+      float t1 = (node.box_max[d] - start[d]) / dir[d];
+      if (t0 > t1)
+        std::swap(t0, t1);
+
+      t_min = std::max(t_min, t0);
+      t_max = std::min(t_max, t1);
+      if (t_min > t_max)
+        return false;
+    }
+
+    t_enter = t_min;
+    return true;
+  }
+
+  public:
+    void build(
+        const std::vector<Vectorf<D>> &box_min,
+        const std::vector<Vectorf<D>> &box_max,
+        float _pad
+        )
+    {
+      /*
+       * box_min, box_max: the corners of the box of every object
+       * _pad: the largest padding of the boxes, the segments are extended
+       *   by this length at both ends
+       */
+      nodes.clear();
+      ids.clear();
+      pad = _pad;
+
+      for (size_t i = 0 ; i < box_min.size() ; i++)
+        ids.push_back(i);
+
+      if (ids.size() > 0)
+        build_node(0, ids.size(), box_min, box_max);
+    }
+
+    bool empty() const { return nodes.size() == 0; }
+
+    // the objects sorted so that every leaf is a contiguous range
+    const std::vector<int> &order() const { return ids; }
+
+    template<class Func>
+    void intersect(
+        const Vectorf<D> &start,
+        const Vectorf<D> &end,
+        const float &max_dist,
+        const Func &visit
+        ) const
+    {
+      /*
+       * Visits the leaves whose box is crossed by the segment (start, end).
+       *
+       * max_dist: only the boxes entered before this distance from start
+       *   are visited. It is read during the traversal so that the visit
+       *   function can shrink it while searching the closest intersection.
+       * visit: a function called as visit(first, count) with the range of
+       *   the candidate objects of a leaf in order().
+       *   It returns true to stop the traversal.
+       */
+      if (nodes.size() == 0)
+        return;
+
+      Vectorf<D> dir = end - start;
+      float length = dir.norm();
+      float t_pad = pad / std::max(length, libroom_eps);
+
+      int stack[max_depth];
+      int stack_size = 0;
+      stack[stack_size++] = 0;
+
+      while (stack_size > 0)
+      {
+        const Node &node = nodes[stack[--stack_size]];
+
+        float t_enter;
+        if (!segment_box(node, start, dir, t_pad, t_enter) || t_enter * length > max_dist + pad)
+          continue;
+
+        if (node.count > 0)
+        {
+          if (visit(node.first, node.count))
+            return;
+          continue;
+        }
+
+        // visit the nearest child first, it is pushed last
+        int left = &node - &nodes[0] + 1;
+        float t_left, t_right;
+        bool hit_left = segment_box(nodes[left], start, dir, t_pad, t_left);
+        bool hit_right = segment_box(nodes[node.right], start, dir, t_pad, t_right);
+
+        if (hit_left && hit_right)
+        {
+          if (t_left <= t_right)
+          {
+            stack[stack_size++] = node.right;
+            stack[stack_size++] = left;
+          }
+          else
+          {
+            stack[stack_size++] = left;
+            stack[stack_size++] = node.right;
+          }
+        }
+        else if (hit_left)
+          stack[stack_size++] = left;
+        else if (hit_right)
+          stack[stack_size++] = node.right;
+      }
+    }
+};
+
+template<size_t D>
+class WallBVH : public BVH<D>
+{
+  /*
+   * The hierarchy over the walls of a room. The boxes are padded so that
+   * every wall for which Wall::intersection reports an intersection
+   * (including the ones found within the geometric tolerance) is visited
+   * by the traversal.
+   */
+  public:
+    void build(const std::vector<Wall<D>> &walls)
+    {
+      float pad = 0.f;
+
+      std::vector<Vectorf<D>> w_min(walls.size()), w_max(walls.size());
+      for (size_t i = 0 ; i < walls.size() ; i++)
+      {
+        const Wall<D> &w = walls[i];
+
+        // The intersection routines accept points that are within
+        // libroom_eps of a wall when measured as a cross product, i.e.,
+        // within libroom_eps / edge length in distance, hence the padding
+        float min_edge = std::numeric_limits<float>::max();
+        int n_corners = w.corners.cols();
+        for (int c = 0 ; c < n_corners ; c++)
+        {
+          float edge = (w.corners.col((c + 1) % n_corners) - w.corners.col(c)).norm();
+          if (edge > 0.f)
+            min_edge = std::min(min_edge, edge);
+        }
+        float w_pad = std::max(1e-3f, 10.f * libroom_eps) + 2.f * libroom_eps / min_edge;
+        pad = std::max(pad, w_pad);
+
+        w_min[i] = w.corners.rowwise().minCoeff().array() - w_pad;
+        w_max[i] = w.corners.rowwise().maxCoeff().array() + w_pad;
+      }
+
+      BVH<D>::build(w_min, w_max, pad);
+    }
+};
+
+#endif // __BVH_HPP__
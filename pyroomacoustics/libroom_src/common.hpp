@@ -29,6 +29,7 @@
 #define __COMMON_HPP__
 
 #include <iostream>
+#include <stdexcept>
 #include <Eigen/Dense>
 
 extern float libroom_eps;  // epsilon is the precision for floating point computations. It is defined in libroom.cpp
@@ -37,10 +38,19 @@ template<size_t D>
 using Vectorf = Eigen::Matrix<float, D, 1>;
 template<size_t D>
 using Vectori = Eigen::Matrix<int, D, 1>;
+// An array of energies over the frequency bands, B can be Eigen::Dynamic
+template<int B>
+using Arrayf = Eigen::Array<float, B, 1>;
 
 using MatrixXf = Eigen::MatrixXf;
 typedef Eigen::Matrix<bool, Eigen::Dynamic, Eigen::Dynamic> MatrixXb;
 typedef Eigen::Matrix<bool, Eigen::Dynamic, 1> VectorXb;
+// The energy histograms of several receivers stacked in one contiguous array
+typedef Eigen::Array<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> RowArrayXXf;
+// The impulse responses of the frequency bands of a receiver
+typedef Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> RowArrayXXd;
+// The indices of the corners of the faces of a mesh, one face per row
+typedef Eigen::Array<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> RowArrayXXi;
 
 /* The 'entry' type is simply defined as an array of 2 floats.
  * It represents an entry that is logged by the microphone
@@ -84,6 +94,12 @@ class Histogram2D
     {
       init(rows, cols);
     }
+    Histogram2D(const Eigen::ArrayXXf &_array, const Eigen::ArrayXXi &_counts)
+      : rows(_array.rows()), cols(_array.cols()), array(_array), counts(_counts)
+    {
+      if (counts.rows() != array.rows() || counts.cols() != array.cols())
+        throw std::runtime_error("Error: The histogram and its counts should have the same size");
+    }
 
     void init(int rows, int cols)
     {
@@ -139,7 +155,8 @@ class Histogram2D
       counts.coeffRef(row, col)++;
     }
 
-    void log_col(Eigen::Index col, const Eigen::ArrayXf &val)
+    template<class Derived>
+    void log_col(Eigen::Index col, const Eigen::ArrayBase<Derived> &val)
     {
       if (col >= array.cols())
         resize_cols(get_new_size(col, array.cols()));
@@ -157,6 +174,22 @@ class Histogram2D
       counts.row(row) += 1;
     }
 
+    void add(const Histogram2D &other)
+    {
+      /*
+       * Accumulates the content of another histogram into this one.
+       * The histogram is grown if the other one is larger.
+       */
+      if (other.array.rows() > array.rows())
+        resize_rows(other.array.rows());
+
+      if (other.array.cols() > array.cols())
+        resize_cols(other.array.cols());
+
+      array.topLeftCorner(other.array.rows(), other.array.cols()) += other.array;
+      counts.topLeftCorner(other.counts.rows(), other.counts.cols()) += other.counts;
+    }
+
     float bin(Eigen::Index row, Eigen::Index col) const
     {
       if (counts.coeff(row, col) != 0)
@@ -169,6 +202,16 @@ class Histogram2D
     {
       return array;
     }
+
+    const Eigen::ArrayXXf &get_array() const
+    {
+      return array;
+    }
+
+    const Eigen::ArrayXXi &get_counts() const
+    {
+      return counts;
+    }
 };
 
 #endif // __COMMON_HPP__
@@ -0,0 +1,283 @@
+/*
+ * Synthesis of the diffuse tails of the impulse responses
+ * Copyright (C) 2019  Robin Scheibler, Cyril Cadoux
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * You should have received a copy of the MIT License along with this program. If
+ * not, see <https://opensource.org/licenses/MIT>.
+ */
+#ifndef __DIFFUSE_TAIL_HPP__
+#define __DIFFUSE_TAIL_HPP__
+
+#include <vector>
+#include <cmath>
+#include <complex>
+#include <random>
+#include <algorithm>
+#include <stdexcept>
+#include <Eigen/Dense>
+#include <unsupported/Eigen/FFT>
+
+#include "common.hpp"
+#include "parallel.hpp"
+
+inline std::vector<int> poisson_sequence(
+    int length,
+    double volume,
+    double c,
+    double fs,
+    double max_rate,
+    std::mt19937 &rng,
+    std::vector<int> &signs
+    )
+{
+  /*
+   * Draws the impulses of the random sequence of the diffuse tail, the same
+   * process as sequence_generation in room.py. The density of reflections
+   * of a room grows with the square of the time, up to max_rate per second.
+   *
+   * Returns the sample indices of the impulses, in increasing order and
+   * without repetition, smaller than length. Their signs, +1 or -1, are
+   * written to signs.
+   */
+  const double pi = 3.14159265358979323846;
+  std::uniform_real_distribution<double> uniform(0., 1.);
+
+  // repeated constant
+  double fpcv = 4. * pi * c * c * c / volume;
+
+  // initial time
+  double t0 = pow(2. * log(2.) / fpcv, 1. / 3.);
+  double duration = length / fs;
+
+  std::vector<int> indices;
+  signs.clear();
+
+  double t = t0;
+  while (true)
+  {
+    int index = int(t * fs);
+    if (index >= length)
+      break;
+
+    int sign = uniform(rng) < 0.5 ? -1 : 1;
+    if (!indices.empty() && indices.back() == index)
+      signs.back() = sign;  // the last impulse of a sample wins
+    else
+    {
+      indices.push_back(index);
+      signs.push_back(sign);
+    }
+
+    if (t >= t0 + duration)
+      break;
+
+    // the rate of the point process at this time and the interval to the next point
+    double mu = std::min(fpcv * (t0 + t) * (t0 + t), max_rate);
+    t += log(1. / (1. - uniform(rng))) / mu;
+  }
+
+  return indices;
+}
+
+inline std::vector<RowArrayXXd> build_diffuse_tails(
+    const std::vector<RowArrayXXf> &histograms,
+    const std::vector<int> &lengths,
+    const RowArrayXXd &filters,
+    const Eigen::ArrayXd &gains,
+    int hist_bin_samples,
+    double volume,
+    double c,
+    double fs,
+    unsigned int seed,
+    int n_threads,
+    double max_rate
+    )
+{
+  /*
+   * Synthesizes the diffuse tails of several impulse responses, e.g., the
+   * ones of all the pairs of sources and microphones of a room, from the
+   * energy histograms of the ray tracing.
+   *
+   * A random sequence of impulses is drawn for every response and filtered
+   * in every band. The filtered sequence is split in the bins of the
+   * histogram, the energy of every bin is normalized and set to the one of
+   * the histogram, and the band is scaled by its gain.
+   *
+   * The band filtering is the same as fftconvolve with mode 'same', done by
+   * overlap-add with short FFTs. The spectra of the filters are computed
+   * once, and the ones of the blocks of a sequence once for all the bands.
+   * The sequences, and then the bands of all the responses, are handed out
+   * to the threads. Every response has its own random generator seeded by
+   * seed and its index, so that the tails do not depend on the number of
+   * threads.
+   *
+   * histograms: the histograms of every response, n_bands x n_bins, the
+   *   missing bins are empty
+   * lengths: the number of samples of every response, a multiple of
+   *   hist_bin_samples
+   * filters: the band pass filters, n_bands x filter length, the filtering
+   *   is skipped when there are none
+   * gains: the gain of every band
+   * hist_bin_samples: the number of samples in a bin of the histograms
+   * volume: the volume of the room
+   * c: the speed of sound
+   * fs: the sampling frequency
+   * seed: the seed of the random sequences
+   * n_threads: the number of threads, 0 means all the cores
+   * max_rate: the largest density of the impulses, per second
+   *
+   * :returns: one n_bands x length array per response
+   */
+  if (lengths.size() != histograms.size())
+    throw std::runtime_error("Error: There should be as many lengths as histograms");
+  if (hist_bin_samples < 1)
+    throw std::runtime_error("Error: The histogram bins should have at least one sample");
+
+  int n_bands = gains.size();
+  if (filters.rows() != 0 && filters.rows() != n_bands)
+    throw std::runtime_error("Error: There should be one filter per band");
+
+  for (size_t r = 0 ; r < histograms.size() ; r++)
+  {
+    if (histograms[r].rows() != n_bands)
+      throw std::runtime_error("Error: The histograms should have one row per band");
+    if (lengths[r] < 0 || lengths[r] % hist_bin_samples != 0)
+      throw std::runtime_error("Error: The length of the responses should be a multiple of the histogram bin size");
+  }
+
+  size_t n_rirs = histograms.size();
+  bool filtering = filters.rows() > 0;
+
+  // the blocks of the overlap-add, the FFTs are a few times longer than the filters
+  int filter_len = filters.cols();
+  int half = (filter_len - 1) / 2;  // the center of the filters, as fftconvolve with mode 'same'
+  int nfft = 2;
+  while (nfft < 4 * filter_len)
+    nfft *= 2;
+  int hop = nfft - filter_len + 1;
+  int n_freq = nfft / 2 + 1;
+
+  // the spectra of the filters, with the scaling of the inverse FFT
+  std::vector<std::complex<double>> filter_spectra;
+  if (filtering)
+  {
+    Eigen::FFT<double> fft;
+    fft.SetFlag(fft.HalfSpectrum);
+    std::vector<double> block(nfft, 0.);
+    filter_spectra.resize(n_bands * n_freq);
+    for (int b = 0 ; b < n_bands ; b++)
+    {
+      for (int k = 0 ; k < filter_len ; k++)
+        block[k] = filters.coeff(b, k) / nfft;
+      fft.fwd(&filter_spectra[b * n_freq], &block[0], nfft);
+    }
+  }
+
+  std::vector<RowArrayXXd> tails(n_rirs);
+  std::vector<std::vector<std::complex<double>>> spectra(n_rirs);  // the blocks of the sequences
+
+  parallel_for(n_rirs, n_threads,
+      [&](size_t r)
+      {
+        std::seed_seq seeds = { seed, (unsigned int)r };
+        std::mt19937 rng(seeds);
+        std::vector<int> signs;
+        std::vector<int> indices = poisson_sequence(lengths[r], volume, c, fs, max_rate, rng, signs);
+
+        // without filters, the sequence is used as is in every band
+        tails[r].setZero(n_bands, lengths[r]);
+        for (size_t i = 0 ; i < indices.size() ; i++)
+          tails[r].col(indices[i]).setConstant(signs[i]);
+
+        if (!filtering)
+          return;
+
+        Eigen::FFT<double> fft;
+        fft.SetFlag(fft.HalfSpectrum);
+        std::vector<double> block(nfft);
+
+        int n_blocks = (lengths[r] + hop - 1) / hop;
+        spectra[r].resize(n_blocks * n_freq);
+        for (int j = 0 ; j < n_blocks ; j++)
+        {
+          int n = std::min(hop, lengths[r] - j * hop);
+          std::fill(block.begin(), block.end(), 0.);
+          for (int k = 0 ; k < n ; k++)
+            block[k] = tails[r].coeff(0, j * hop + k);
+          fft.fwd(&spectra[r][j * n_freq], &block[0], nfft);
+        }
+      }
+      );
+
+  parallel_for(n_rirs * n_bands, n_threads,
+      [&](size_t task)
+      {
+        size_t r = task / n_bands;
+        int b = task % n_bands;
+        int length = lengths[r];
+        auto tail = tails[r].row(b);
+
+        if (filtering)
+        {
+          Eigen::FFT<double> fft;
+          fft.SetFlag(fft.HalfSpectrum);
+          fft.SetFlag(fft.Unscaled);
+          std::vector<std::complex<double>> product(n_freq);
+          std::vector<double> block(nfft);
+
+          // the sequence is kept in the spectra of its blocks
+          tail.setZero();
+
+          int n_blocks = spectra[r].size() / n_freq;
+          for (int j = 0 ; j < n_blocks ; j++)
+          {
+            for (int f = 0 ; f < n_freq ; f++)
+              product[f] = spectra[r][j * n_freq + f] * filter_spectra[b * n_freq + f];
+            fft.inv(&block[0], &product[0], nfft);
+
+            // the full convolution of the block starts at j * hop, minus the
+            // center of the filters in the output
+            int start = j * hop - half;
+            int first = std::max(0, -start), last = std::min(hop + filter_len - 1, length - start);
+            for (int k = first ; k < last ; k++)
+              tail.coeffRef(start + k) += block[k];
+          }
+        }
+
+        // set the energy of every bin to the one of the histogram
+        const RowArrayXXf &hist = histograms[r];
+        for (int bin = 0 ; bin * hist_bin_samples < length ; bin++)
+        {
+          auto seg = tail.segment(bin * hist_bin_samples, hist_bin_samples);
+          double energy = bin < hist.cols() ? hist.coeff(b, bin) : 0.;
+          double norm = seg.matrix().norm();
+          double scale = gains.coeff(b) * sqrt(energy);
+          if (norm > 0.)
+            scale /= norm;
+          seg *= scale;
+        }
+      }
+      );
+
+  return tails;
+}
+
+#endif // __DIFFUSE_TAIL_HPP__
@@ -235,7 +235,7 @@ Eigen::Vector3f cross(Eigen::Vector3f v1, Eigen::Vector3f v2)
 
 
 int is_inside_2d_polygon(const Eigen::Vector2f &p,
-    const Eigen::Matrix<float,2,Eigen::Dynamic> &corners)
+    const Eigen::Ref<const Eigen::Matrix<float,2,Eigen::Dynamic>> &corners)
 {
   /*
     Checks if a given point is inside a given polygon in 2D.
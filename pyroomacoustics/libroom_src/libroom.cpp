@@ -29,6 +29,7 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/eigen.h>
 #include <pybind11/stl.h>
+#include <pybind11/numpy.h>
 #include <Eigen/Dense>
 
 #include "common.hpp"
@@ -36,16 +37,92 @@
 #include "microphone.hpp"
 #include "wall.hpp"
 #include "room.hpp"
+#include "rir_builder.hpp"
+#include "batch.hpp"
+#include "serialize.hpp"
+#include "diffuse_tail.hpp"
 
 namespace py = pybind11;
 
 float libroom_eps = 1e-5;  // epsilon is set to 0.1 millimeter (100 um)
 
+template<size_t D, RowArrayXXf (Room<D>::*method)(size_t, const Eigen::Matrix<float,D,Eigen::Dynamic> &)>
+py::array_t<float> histogram_tensor(
+    Room<D> &room,
+    size_t n_rays,
+    const Eigen::Matrix<float,D,Eigen::Dynamic> &source_locs
+    )
+{
+  /*
+   * Runs one of the multi-source ray tracing methods and returns the
+   * histograms as a (n_sources, n_mics, n_bands, n_bins) array that owns
+   * the memory filled by the engine. The GIL is released during the ray
+   * tracing.
+   */
+  RowArrayXXf *stack;
+  {
+    py::gil_scoped_release release;
+    stack = new RowArrayXXf((room.*method)(n_rays, source_locs));
+  }
+  py::capsule owner(stack, [](void *p) { delete reinterpret_cast<RowArrayXXf *>(p); });
+
+  std::vector<size_t> shape = {
+    size_t(source_locs.cols()),
+    room.microphones.size(),
+    room.n_bands,
+    size_t(stack->cols())
+  };
+
+  return py::array_t<float>(shape, stack->data(), owner);
+}
+
+template<size_t D>
+py::dict release_image_sources(Room<D> &room)
+{
+  /*
+   * Moves the image sources found by the last call to image_source_model
+   * into numpy arrays that own the memory, without copying. The arrays of
+   * the room are left empty until the next call.
+   */
+  py::dict images;
+  images["sources"] = py::cast(std::move(room.sources));
+  images["orders"] = py::cast(std::move(room.orders));
+  images["orders_xyz"] = py::cast(std::move(room.orders_xyz));
+  images["gen_walls"] = py::cast(std::move(room.gen_walls));
+  images["attenuations"] = py::cast(std::move(room.attenuations));
+  images["visible_mics"] = py::cast(std::move(room.visible_mics));
+  return images;
+}
+
+template<size_t D>
+ImageSourceTree<D> release_image_source_tree(Room<D> &room)
+{
+  /*
+   * Moves the tree of image sources kept by the last call to
+   * image_source_model out of the room
+   */
+  ImageSourceTree<D> tree = std::move(room.ism_tree);
+  room.ism_tree = ImageSourceTree<D>();
+  return tree;
+}
+
+template<size_t D>
+py::bytes room_state(const Room<D> &room, bool results)
+{
+  /*
+   * Serializes a room to bytes, with the image sources and the histograms
+   * of the last run if results is true
+   */
+  return py::bytes(room_to_bytes(room, results));
+}
+
 
 PYBIND11_MODULE(libroom, m) {
   m.doc() = "Libroom room simulation extension plugin"; // optional module docstring
 
   // The 3D Room class
+  // The long running methods release the GIL, distinct rooms can be
+  // simulated at the same time on several Python threads
   py::class_<Room<3>>(m, "Room")
     .def(py::init<
         const std::vector<Wall<3>> &,
@@ -60,10 +137,27 @@ PYBIND11_MODULE(libroom, m) {
         const std::vector<Microphone<3>> &,
         float, int, float, float, float, float, bool
         >())
+    .def(py::init<
+        const Eigen::Matrix<float,3,Eigen::Dynamic> &,
+        const RowArrayXXi &,
+        const Eigen::ArrayXXf &,
+        const Eigen::ArrayXXf &,
+        const std::vector<int> &,
+        const std::vector<Microphone<3>> &,
+        float, int, float, float, float, float, bool
+        >())
     .def("set_params", &Room<3>::set_params)
     .def("add_mic", &Room<3>::add_mic)
+    .def("set_mics", &Room<3>::set_mics)
     .def("reset_mics", &Room<3>::reset_mics)
-    .def("image_source_model", &Room<3>::image_source_model)
+    .def("image_source_model", &Room<3>::image_source_model, py::call_guard<py::gil_scoped_release>())
+    .def("release_image_sources", &release_image_sources<3>)
+    .def("release_image_source_tree", &release_image_source_tree<3>)
+    .def("image_source_visibility", &Room<3>::image_source_visibility, py::call_guard<py::gil_scoped_release>())
+    .def("move_image_source_tree", &Room<3>::move_image_source_tree)
+    .def("shoebox_rir", &Room<3>::shoebox_rir,
+        py::arg("source"), py::arg("fs"), py::arg("c"), py::arg("fdl"), py::arg("lut_gran") = 20,
+        py::arg("length") = 0, py::call_guard<py::gil_scoped_release>())
     .def("get_wall", &Room<3>::get_wall)
     .def("get_max_distance", &Room<3>::get_max_distance)
     .def("next_wall_hit", &Room<3>::next_wall_hit)
@@ -75,7 +169,7 @@ PYBIND11_MODULE(libroom, m) {
                              const Vectorf<3> source_pos
                              )
         )
-        &Room<3>::ray_tracing)
+        &Room<3>::ray_tracing, py::call_guard<py::gil_scoped_release>())
     .def("ray_tracing",
         (void (Room<3>::*)(
                              size_t nb_phis,
@@ -83,16 +177,25 @@ PYBIND11_MODULE(libroom, m) {
                              const Vectorf<3> source_pos
                              )
         )
-        &Room<3>::ray_tracing)
+        &Room<3>::ray_tracing, py::call_guard<py::gil_scoped_release>())
     .def("ray_tracing",
         (void (Room<3>::*)(
                              size_t nb_rays,
                              const Vectorf<3> source_pos
                              )
         )
-        &Room<3>::ray_tracing)
+        &Room<3>::ray_tracing, py::call_guard<py::gil_scoped_release>())
+    .def("ray_tracing_sources", &histogram_tensor<3, &Room<3>::ray_tracing_sources>)
+    .def("ray_tracing_reciprocal", &histogram_tensor<3, &Room<3>::ray_tracing_reciprocal>)
     .def("contains", &Room<3>::contains)
     .def_property("is_hybrid_sim", &Room<3>::get_is_hybrid_sim, &Room<3>::set_is_hybrid_sim)
+    .def_property("n_threads", &Room<3>::get_n_threads, &Room<3>::set_n_threads)
+    .def_property("ray_packet_size", &Room<3>::get_ray_packet_size, &Room<3>::set_ray_packet_size)
+    .def_property("visibility_patch_size", &Room<3>::get_visibility_patch_size, &Room<3>::set_visibility_patch_size)
+    .def_property("ism_n_threads", &Room<3>::get_ism_n_threads, &Room<3>::set_ism_n_threads)
+    .def_property("ism_max_distance", &Room<3>::get_ism_max_distance, &Room<3>::set_ism_max_distance)
+    .def_property("ism_beam_pruning", &Room<3>::get_ism_beam_pruning, &Room<3>::set_ism_beam_pruning)
+    .def_property("ism_keep_tree", &Room<3>::get_ism_keep_tree, &Room<3>::set_ism_keep_tree)
     .def_property_readonly_static("dim", [](py::object /* self */) { return 3; })
     .def_readonly("walls", &Room<3>::walls)
     .def_readonly("sources", &Room<3>::sources)
@@ -103,8 +206,14 @@ PYBIND11_MODULE(libroom, m) {
     .def_readonly("visible_mics", &Room<3>::visible_mics)
     .def_readonly("walls", &Room<3>::walls)
     .def_readonly("obstructing_walls", &Room<3>::obstructing_walls)
-    .def_readonly("microphones", &Room<3>::microphones)
+    .def_property_readonly("microphones", [](const Room<3> &room) { return room.microphones; })
     .def_readonly("max_dist", &Room<3>::max_dist)
+    .def("to_bytes", &room_state<3>, py::arg("results") = true)
+    .def_static("from_bytes", [](py::bytes b) { return room_from_bytes<3>(b); })
+    .def(py::pickle(
+          [](const Room<3> &room) { return room_state(room, true); },
+          [](py::bytes b) { return room_from_bytes<3>(b); }
+          ))
     ;
 
   // The 2D Room class
@@ -123,10 +232,27 @@ PYBIND11_MODULE(libroom, m) {
         const std::vector<Microphone<2>> &,
         float, int, float, float, float, float, bool
         >())
+    .def(py::init<
+        const Eigen::Matrix<float,2,Eigen::Dynamic> &,
+        const RowArrayXXi &,
+        const Eigen::ArrayXXf &,
+        const Eigen::ArrayXXf &,
+        const std::vector<int> &,
+        const std::vector<Microphone<2>> &,
+        float, int, float, float, float, float, bool
+        >())
     .def("set_params", &Room<2>::set_params)
     .def("add_mic", &Room<2>::add_mic)
+    .def("set_mics", &Room<2>::set_mics)
     .def("reset_mics", &Room<2>::reset_mics)
-    .def("image_source_model", &Room<2>::image_source_model)
+    .def("image_source_model", &Room<2>::image_source_model, py::call_guard<py::gil_scoped_release>())
+    .def("release_image_sources", &release_image_sources<2>)
+    .def("release_image_source_tree", &release_image_source_tree<2>)
+    .def("image_source_visibility", &Room<2>::image_source_visibility, py::call_guard<py::gil_scoped_release>())
+    .def("move_image_source_tree", &Room<2>::move_image_source_tree)
+    .def("shoebox_rir", &Room<2>::shoebox_rir,
+        py::arg("source"), py::arg("fs"), py::arg("c"), py::arg("fdl"), py::arg("lut_gran") = 20,
+        py::arg("length") = 0, py::call_guard<py::gil_scoped_release>())
     .def("get_wall", &Room<2>::get_wall)
     .def("get_max_distance", &Room<2>::get_max_distance)
     .def("next_wall_hit", &Room<2>::next_wall_hit)
@@ -138,7 +264,7 @@ PYBIND11_MODULE(libroom, m) {
                              const Vectorf<2> source_pos
                             )
         )
-        &Room<2>::ray_tracing)
+        &Room<2>::ray_tracing, py::call_guard<py::gil_scoped_release>())
     .def("ray_tracing",
         (void (Room<2>::*)(
                              size_t nb_phis,
@@ -146,17 +272,26 @@ PYBIND11_MODULE(libroom, m) {
                              const Vectorf<2> source_pos
                             )
         )
-        &Room<2>::ray_tracing)
+        &Room<2>::ray_tracing, py::call_guard<py::gil_scoped_release>())
     .def("ray_tracing",
         (void (Room<2>::*)(
                              size_t n_rays,
                              const Vectorf<2> source_pos
                             )
         )
-        &Room<2>::ray_tracing)
+        &Room<2>::ray_tracing, py::call_guard<py::gil_scoped_release>())
+    .def("ray_tracing_sources", &histogram_tensor<2, &Room<2>::ray_tracing_sources>)
+    .def("ray_tracing_reciprocal", &histogram_tensor<2, &Room<2>::ray_tracing_reciprocal>)
     .def("contains", &Room<2>::contains)
     .def_property_readonly_static("dim", [](py::object /* self */) { return 2; })
     .def_property("is_hybrid_sim", &Room<2>::get_is_hybrid_sim, &Room<2>::set_is_hybrid_sim)
+    .def_property("n_threads", &Room<2>::get_n_threads, &Room<2>::set_n_threads)
+    .def_property("ray_packet_size", &Room<2>::get_ray_packet_size, &Room<2>::set_ray_packet_size)
+    .def_property("visibility_patch_size", &Room<2>::get_visibility_patch_size, &Room<2>::set_visibility_patch_size)
+    .def_property("ism_n_threads", &Room<2>::get_ism_n_threads, &Room<2>::set_ism_n_threads)
+    .def_property("ism_max_distance", &Room<2>::get_ism_max_distance, &Room<2>::set_ism_max_distance)
+    .def_property("ism_beam_pruning", &Room<2>::get_ism_beam_pruning, &Room<2>::set_ism_beam_pruning)
+    .def_property("ism_keep_tree", &Room<2>::get_ism_keep_tree, &Room<2>::set_ism_keep_tree)
     .def_readonly("walls", &Room<2>::walls)
     .def_readonly("sources", &Room<2>::sources)
     .def_readonly("orders", &Room<2>::orders)
@@ -166,8 +301,45 @@ PYBIND11_MODULE(libroom, m) {
     .def_readonly("visible_mics", &Room<2>::visible_mics)
     .def_readonly("walls", &Room<2>::walls)
     .def_readonly("obstructing_walls", &Room<2>::obstructing_walls)
-    .def_readonly("microphones", &Room<2>::microphones)
+    .def_property_readonly("microphones", [](const Room<2> &room) { return room.microphones; })
     .def_readonly("max_dist", &Room<2>::max_dist)
+    .def("to_bytes", &room_state<2>, py::arg("results") = true)
+    .def_static("from_bytes", [](py::bytes b) { return room_from_bytes<2>(b); })
+    .def(py::pickle(
+          [](const Room<2> &room) { return room_state(room, true); },
+          [](py::bytes b) { return room_from_bytes<2>(b); }
+          ))
+    ;
+
+  // The trees of image sources kept between runs of the image source model
+  py::class_<ImageSourceTree<3>>(m, "ImageSourceTree")
+    .def("__len__", &ImageSourceTree<3>::size)
+    .def_readonly("source", &ImageSourceTree<3>::source)
+    .def_readonly("is_shoebox", &ImageSourceTree<3>::is_shoebox)
+    .def_readonly("locs", &ImageSourceTree<3>::locs)
+    .def_readonly("attenuations", &ImageSourceTree<3>::attenuations)
+    .def_readonly("orders", &ImageSourceTree<3>::orders)
+    .def_readonly("gen_walls", &ImageSourceTree<3>::gen_walls)
+    .def_readonly("parents", &ImageSourceTree<3>::parents)
+    .def_readonly("linear", &ImageSourceTree<3>::linear)
+    .def_readonly("offsets", &ImageSourceTree<3>::offsets)
+    .def_readonly("anchor", &ImageSourceTree<3>::anchor)
+    .def_readonly("move_radius", &ImageSourceTree<3>::move_radius)
+    ;
+
+  py::class_<ImageSourceTree<2>>(m, "ImageSourceTree2D")
+    .def("__len__", &ImageSourceTree<2>::size)
+    .def_readonly("source", &ImageSourceTree<2>::source)
+    .def_readonly("is_shoebox", &ImageSourceTree<2>::is_shoebox)
+    .def_readonly("locs", &ImageSourceTree<2>::locs)
+    .def_readonly("attenuations", &ImageSourceTree<2>::attenuations)
+    .def_readonly("orders", &ImageSourceTree<2>::orders)
+    .def_readonly("gen_walls", &ImageSourceTree<2>::gen_walls)
+    .def_readonly("parents", &ImageSourceTree<2>::parents)
+    .def_readonly("linear", &ImageSourceTree<2>::linear)
+    .def_readonly("offsets", &ImageSourceTree<2>::offsets)
+    .def_readonly("anchor", &ImageSourceTree<2>::anchor)
+    .def_readonly("move_radius", &ImageSourceTree<2>::move_radius)
     ;
 
   // The Wall class
@@ -194,6 +366,12 @@ PYBIND11_MODULE(libroom, m) {
     .def_readonly("normal", &Wall<3>::normal)
     .def_readonly("basis", &Wall<3>::basis)
     .def_readonly("flat_corners", &Wall<3>::flat_corners)
+    .def("to_bytes", [](const Wall<3> &wall) { return py::bytes(wall_to_bytes(wall)); })
+    .def_static("from_bytes", [](py::bytes b) { return wall_from_bytes<3>(b); })
+    .def(py::pickle(
+          [](const Wall<3> &wall) { return py::bytes(wall_to_bytes(wall)); },
+          [](py::bytes b) { return wall_from_bytes<3>(b); }
+          ))
     ;
 
   py::enum_<Wall<3>::Isect>(wall_cls, "Isect")
@@ -227,6 +405,12 @@ PYBIND11_MODULE(libroom, m) {
     .def_readonly("normal", &Wall<2>::normal)
     .def_readonly("basis", &Wall<2>::basis)
     .def_readonly("flat_corners", &Wall<2>::flat_corners)
+    .def("to_bytes", [](const Wall<2> &wall) { return py::bytes(wall_to_bytes(wall)); })
+    .def_static("from_bytes", [](py::bytes b) { return wall_from_bytes<2>(b); })
+    .def(py::pickle(
+          [](const Wall<2> &wall) { return py::bytes(wall_to_bytes(wall)); },
+          [](py::bytes b) { return wall_from_bytes<2>(b); }
+          ))
     ;
 
   // The different wall intersection cases
@@ -240,14 +424,26 @@ PYBIND11_MODULE(libroom, m) {
     .def(py::init<const Vectorf<3> &, int, float, float>())
     .def_readonly("loc", &Microphone<3>::loc)
     .def_readonly("hits", &Microphone<3>::hits)
-    .def_readonly("histograms", &Microphone<3>::histograms)
+    .def_property_readonly("histograms", [](const Microphone<3> &mic) { return mic.histograms; })
+    .def("to_bytes", [](const Microphone<3> &mic) { return py::bytes(microphone_to_bytes(mic)); })
+    .def_static("from_bytes", [](py::bytes b) { return microphone_from_bytes<3>(b); })
+    .def(py::pickle(
+          [](const Microphone<3> &mic) { return py::bytes(microphone_to_bytes(mic)); },
+          [](py::bytes b) { return microphone_from_bytes<3>(b); }
+          ))
     ;
 
   py::class_<Microphone<2>>(m, "Microphone2D")
     .def(py::init<const Vectorf<2> &, int, float, float>())
     .def_readonly("loc", &Microphone<2>::loc)
     .def_readonly("hits", &Microphone<2>::hits)
-    .def_readonly("histograms", &Microphone<2>::histograms)
+    .def_property_readonly("histograms", [](const Microphone<2> &mic) { return mic.histograms; })
+    .def("to_bytes", [](const Microphone<2> &mic) { return py::bytes(microphone_to_bytes(mic)); })
+    .def_static("from_bytes", [](py::bytes b) { return microphone_from_bytes<2>(b); })
+    .def(py::pickle(
+          [](const Microphone<2> &mic) { return py::bytes(microphone_to_bytes(mic)); },
+          [](py::bytes b) { return microphone_from_bytes<2>(b); }
+          ))
     ;
 
   // The 2D histogram class
@@ -257,6 +453,13 @@ PYBIND11_MODULE(libroom, m) {
     .def("bin", &Histogram2D::bin)
     .def("get_hist", &Histogram2D::get_hist)
     .def("reset", &Histogram2D::reset)
+    .def("get_counts", &Histogram2D::get_counts, py::return_value_policy::copy)
+    .def("to_bytes", [](const Histogram2D &hist) { return py::bytes(histogram_to_bytes(hist)); })
+    .def_static("from_bytes", [](py::bytes b) { return histogram_from_bytes(b); })
+    .def(py::pickle(
+          [](const Histogram2D &hist) { return py::bytes(histogram_to_bytes(hist)); },
+          [](py::bytes b) { return histogram_from_bytes(b); }
+          ))
     ;
 
   // Structure to hold detector hit information
@@ -300,5 +503,40 @@ PYBIND11_MODULE(libroom, m) {
   m.def("dist_line_point", &dist_line_point,
       "Computes the distance between a point and an infinite line");
 
+  // Construction of the impulse responses from the image sources
+  m.def("build_rirs", &build_rirs,
+      "Builds several impulse responses from the delays and amplitudes of image sources",
+      py::arg("times"), py::arg("alphas"), py::arg("visibilities"), py::arg("lengths"),
+      py::arg("fs"), py::arg("fdl"), py::arg("lut_gran") = 20, py::arg("n_threads") = 1,
+      py::call_guard<py::gil_scoped_release>());
+
+  // Synthesis of the diffuse tails from the histograms of the ray tracing
+  m.def("build_diffuse_tails", &build_diffuse_tails,
+      "Synthesizes the diffuse tails of several impulse responses from energy histograms",
+      py::arg("histograms"), py::arg("lengths"), py::arg("filters"), py::arg("gains"),
+      py::arg("hist_bin_samples"), py::arg("volume"), py::arg("c"), py::arg("fs"),
+      py::arg("seed"), py::arg("n_threads") = 1, py::arg("max_rate") = 10000.,
+      py::call_guard<py::gil_scoped_release>());
+
+  m.def("shoebox_rir_batch", &shoebox_rir_batch<3>,
+      "Builds the impulse responses of many shoebox rooms",
+      py::arg("room_sizes"), py::arg("absorption"), py::arg("scattering"),
+      py::arg("sources"), py::arg("mics"), py::arg("max_order"), py::arg("fs"), py::arg("c"),
+      py::arg("fdl"), py::arg("filters"), py::arg("gains"), py::arg("air_absorption"),
+      py::arg("n_rays"), py::arg("energy_thres"), py::arg("time_thres"),
+      py::arg("receiver_radius"), py::arg("hist_bin_samples"), py::arg("seed"), py::arg("out"),
+      py::arg("lut_gran") = 20, py::arg("n_threads") = 0,
+      py::call_guard<py::gil_scoped_release>());
+
+  m.def("shoebox_rir_batch2D", &shoebox_rir_batch<2>,
+      "Builds the impulse responses of many 2D shoebox rooms",
+      py::arg("room_sizes"), py::arg("absorption"), py::arg("scattering"),
+      py::arg("sources"), py::arg("mics"), py::arg("max_order"), py::arg("fs"), py::arg("c"),
+      py::arg("fdl"), py::arg("filters"), py::arg("gains"), py::arg("air_absorption"),
+      py::arg("n_rays"), py::arg("energy_thres"), py::arg("time_thres"),
+      py::arg("receiver_radius"), py::arg("hist_bin_samples"), py::arg("seed"), py::arg("out"),
+      py::arg("lut_gran") = 20, py::arg("n_threads") = 0,
+      py::call_guard<py::gil_scoped_release>());
+
 }
 
@@ -71,6 +71,13 @@ class Microphone
         h->reset();
     }
 
+    void merge(const Microphone<D> &other)
+    {
+      // Accumulates the histograms logged by another copy of this receiver
+      for (size_t i = 0 ; i < histograms.size() ; i++)
+        histograms[i].add(other.histograms[i]);
+    }
+
     const Vectorf<D> &get_loc() const
     {
       return loc;
@@ -97,7 +104,8 @@ class Microphone
       hits.push_back(copy_hit);
     }
 
-    void log_histogram(float distance, const Eigen::ArrayXf &energy, const Vectorf<D> &origin)
+    template<class Derived>
+    void log_histogram(float distance, const Eigen::ArrayBase<Derived> &energy, const Vectorf<D> &origin)
     {
       // first find the bin index
       auto dist_bin_index = size_t(distance / hist_resolution);
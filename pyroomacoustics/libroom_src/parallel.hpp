@@ -0,0 +1,109 @@
+/*
+ * Small helpers to distribute work over a few threads
+ * Copyright (C) 2019  Robin Scheibler, Cyril Cadoux
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * You should have received a copy of the MIT License along with this program. If
+ * not, see <https://opensource.org/licenses/MIT>.
+ */
+#ifndef __PARALLEL_HPP__
+#define __PARALLEL_HPP__
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <algorithm>
+
+inline int get_num_threads(int n_threads)
+{
+  /*
+   * Resolves the number of threads requested by the user.
+   * A value smaller than one means that all the available cores are used.
+   */
+  if (n_threads > 0)
+    return n_threads;
+
+  int n_cores = int(std::thread::hardware_concurrency());
+  return n_cores > 0 ? n_cores : 1;
+}
+
+template<class Func>
+void parallel_for(size_t n_tasks, int n_threads, const Func &func)
+{
+  /*
+   * Runs func(task) for task = 0, ..., n_tasks - 1 on n_threads threads.
+   *
+   * The tasks are handed out dynamically, one at a time, so that the threads
+   * stay busy even when tasks have very different costs. Which thread runs
+   * a given task is thus not deterministic and func should only write to
+   * memory that is owned by the task.
+   *
+   * The first exception thrown by a task is re-thrown in the calling thread
+   * once all the threads have joined.
+   */
+  n_threads = std::min<int>(get_num_threads(n_threads), int(n_tasks));
+
+  if (n_threads <= 1)
+  {
+    for (size_t task = 0 ; task < n_tasks ; task++)
+      func(task);
+    return;
+  }
+
+  std::atomic<size_t> next_task(0);
+  std::exception_ptr error = nullptr;
+  std::atomic<bool> failed(false);
+
+  auto worker = [&]()
+  {
+    while (!failed)
+    {
+      size_t task = next_task++;
+      if (task >= n_tasks)
+        break;
+
+      try
+      {
+        func(task);
+      }
+      catch (...)
+      {
+        // only the first error is kept
+        if (!failed.exchange(true))
+          error = std::current_exception();
+      }
+    }
+  };
+
+  // the calling thread does its share of the work too
+  std::vector<std::thread> threads;
+  for (int t = 1 ; t < n_threads ; t++)
+    threads.push_back(std::thread(worker));
+  worker();
+
+  for (auto &th : threads)
+    th.join();
+
+  if (error)
+    std::rethrow_exception(error);
+}
+
+#endif // __PARALLEL_HPP__
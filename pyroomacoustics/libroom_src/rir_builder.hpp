@@ -0,0 +1,186 @@
+/*
+ * Construction of the room impulse responses from the image sources
+ * Copyright (C) 2019  Robin Scheibler, Cyril Cadoux
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * You should have received a copy of the MIT License along with this program. If
+ * not, see <https://opensource.org/licenses/MIT>.
+ */
+#ifndef __RIR_BUILDER_HPP__
+#define __RIR_BUILDER_HPP__
+
+#include <vector>
+#include <cmath>
+#include <stdexcept>
+#include <Eigen/Dense>
+
+#include "common.hpp"
+#include "parallel.hpp"
+
+class RirBuilder
+{
+  /*
+   * Adds the fractional delay filters of image sources to impulse responses.
+   *
+   * The filters are the same as the ones of fast_rir_builder: a sinc of
+   * fdl taps windowed by a Hann window, sampled in a look-up table with
+   * lut_gran points per unit and interpolated linearly. The look-up table
+   * is stored in polyphase form, the windowed taps of every offset in the
+   * table in a contiguous row, together with the slopes to the next
+   * offset, so that the filter of an image is a linear combination of two
+   * rows that Eigen vectorizes.
+   *
+   * The filters are centered on the delay of the image sources plus
+   * (fdl - 1) / 2 samples so that they fit in the response.
+   */
+  int fdl, fdl2, lut_gran;
+  Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> taps, slopes;  // (lut_gran + 1) x fdl
+
+  public:
+    RirBuilder(int _fdl, int _lut_gran = 20)
+      : fdl(_fdl), fdl2((_fdl - 1) / 2), lut_gran(_lut_gran)
+    {
+      if (fdl % 2 != 1)
+        throw std::runtime_error("Error: The fractional delay filter length should be odd");
+      if (lut_gran < 1)
+        throw std::runtime_error("Error: The look-up table granularity should be positive");
+
+      const double pi = 3.14159265358979323846;
+
+      // the sinc on [-fdl2 - 1, fdl2 + 1] and the window
+      int lut_size = (fdl + 1) * lut_gran + 1;
+      std::vector<double> sinc_lut(lut_size), hann(fdl);
+      for (int i = 0 ; i < lut_size ; i++)
+      {
+        double x = -fdl2 - 1 + double(i) / lut_gran;
+        sinc_lut[i] = x == 0. ? 1. : sin(pi * x) / (pi * x);
+      }
+      for (int k = 0 ; k < fdl ; k++)
+        hann[k] = fdl == 1 ? 1. : 0.5 - 0.5 * cos(2. * pi * k / (fdl - 1));
+
+      taps.resize(lut_gran + 1, fdl);
+      slopes.resize(lut_gran + 1, fdl);
+      for (int p = 0 ; p <= lut_gran ; p++)
+        for (int k = 0 ; k < fdl ; k++)
+        {
+          int pos = p + k * lut_gran;
+          taps(p, k) = hann[k] * sinc_lut[pos];
+          slopes(p, k) = hann[k] * (sinc_lut[pos + 1] - sinc_lut[pos]);
+        }
+    }
+
+    int length() const { return fdl; }
+
+    // The length of a response that holds the filter of a delay of time
+    int min_length(double time, double fs) const
+    {
+      return int(ceil(time * fs)) + fdl;
+    }
+
+    template<class Derived>
+    void add(
+        RowArrayXXd &rir,
+        double time,
+        double fs,
+        const Eigen::ArrayBase<Derived> &alpha
+        ) const
+    {
+      /*
+       * Adds the filter of an image source to the responses of all the bands
+       *
+       * rir: the responses, one band per row
+       * time: the delay of the image source in seconds
+       * fs: the sampling frequency
+       * alpha: the amplitude of the image source in every band
+       */
+
+      // decompose integer and fractional delay, with the same rounding as
+      // fast_rir_builder
+      float sample_frac = fs * (time + fdl2 / fs);
+      int time_ip = int(floor(sample_frac));
+      float time_fp = sample_frac - time_ip;
+
+      // the offset in the look-up table
+      float x_off_frac = (1. - time_fp) * lut_gran;
+      int lut_gran_off = int(floor(x_off_frac));
+      float x_off = x_off_frac - lut_gran_off;
+
+      int start = time_ip - fdl2;
+      if (start < 0 || start + fdl > rir.cols())
+        throw std::runtime_error("Error: The delay of an image source is out of the impulse response");
+
+      for (int b = 0 ; b < rir.rows() ; b++)
+        rir.row(b).segment(start, fdl) += alpha.coeff(b)
+          * (taps.row(lut_gran_off) + double(x_off) * slopes.row(lut_gran_off));
+    }
+};
+
+inline std::vector<RowArrayXXd> build_rirs(
+    const std::vector<Eigen::VectorXd> &times,
+    const std::vector<Eigen::ArrayXXd> &alphas,
+    const std::vector<Eigen::VectorXi> &visibilities,
+    const std::vector<int> &lengths,
+    double fs,
+    int fdl,
+    int lut_gran,
+    int n_threads
+    )
+{
+  /*
+   * Builds several impulse responses at once, e.g., the ones of all the
+   * pairs of sources and microphones of a room.
+   *
+   * times: the delays of the image sources of every response
+   * alphas: the amplitudes of the image sources of every response, n_bands x n_images
+   * visibilities: 1 if the image source is visible, 0 if not, for every response
+   * lengths: the number of samples of every response
+   * fs: the sampling frequency
+   * fdl: the length of the fractional delay filter (odd)
+   * lut_gran: the number of point per unit in the sinc interpolation table
+   * n_threads: the number of threads, the responses are built in parallel
+   *
+   * :returns: one n_bands x length array per response
+   */
+  if (alphas.size() != times.size() || visibilities.size() != times.size()
+      || lengths.size() != times.size())
+    throw std::runtime_error("Error: There should be as many delays, amplitudes, visibilities and lengths");
+
+  for (size_t r = 0 ; r < times.size() ; r++)
+    if (alphas[r].cols() != times[r].size() || visibilities[r].size() != times[r].size())
+      throw std::runtime_error("Error: There should be a delay, amplitude and visibility for every image source");
+
+  RirBuilder builder(fdl, lut_gran);
+  std::vector<RowArrayXXd> rirs(times.size());
+
+  parallel_for(times.size(), n_threads,
+      [&](size_t r)
+      {
+        rirs[r].setZero(alphas[r].rows(), lengths[r]);
+
+        for (int i = 0 ; i < times[r].size() ; i++)
+          if (visibilities[r][i] == 1)
+            builder.add(rirs[r], times[r][i], fs, alphas[r].col(i));
+      }
+      );
+
+  return rirs;
+}
+
+#endif // __RIR_BUILDER_HPP__
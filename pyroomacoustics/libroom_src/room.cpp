@@ -103,6 +103,83 @@ Room<D>::Room(
   init();
 }
 
+template<size_t D>
+Room<D>::Room(
+    const Eigen::Matrix<float,D,Eigen::Dynamic> &_vertices,
+    const RowArrayXXi &_faces,
+    const Eigen::ArrayXXf &_absorption,
+    const Eigen::ArrayXXf &_scattering,
+    const std::vector<int> &_obstructing_walls,
+    const std::vector<Microphone<D>> &_microphones,
+    float _sound_speed,
+    // parameters for the image source model
+    int _ism_order,
+    // parameters for the ray tracing
+    float _energy_thres,
+    float _time_thres,
+    float _mic_radius,
+    float _mic_hist_res,
+    bool _is_hybrid_sim
+    )
+  : obstructing_walls(_obstructing_walls), microphones(_microphones),
+  sound_speed(_sound_speed), ism_order(_ism_order),
+  energy_thres(_energy_thres), time_thres(_time_thres), mic_radius(_mic_radius),
+  mic_radius_sq(_mic_radius * _mic_radius),
+  mic_hist_res(_mic_hist_res), is_hybrid_sim(_is_hybrid_sim), is_shoebox(false)
+{
+  make_mesh_walls(_vertices, _faces, _absorption, _scattering);
+  init();
+}
+
+template<size_t D>
+void Room<D>::make_mesh_walls(
+    const Eigen::Matrix<float,D,Eigen::Dynamic> &vertices,
+    const RowArrayXXi &faces,
+    const Eigen::ArrayXXf &abs,
+    const Eigen::ArrayXXf &scat
+    )
+{
+  /*
+   * Builds one wall per face of a mesh, in a single pass over the faces.
+   *
+   * vertices: D x n_vertices, the corners shared by the faces
+   * faces: n_faces x max_corners, the indices of the corners of every face,
+   *   in order, followed by negative values when the face has fewer corners
+   * abs: n_bands x n_faces, the absorption of every face
+   * scat: n_bands x n_faces, the scattering of every face
+   */
+  int n_faces = faces.rows();
+
+  if (abs.cols() != n_faces || scat.cols() != n_faces)
+    throw std::runtime_error("Error: There should be one absorption and scattering coefficient per face and band");
+  if (abs.rows() != scat.rows() || abs.rows() == 0)
+    throw std::runtime_error("Error: The same number of absorption and scattering coefficients are required");
+
+  walls.clear();
+  walls.reserve(n_faces);
+
+  Eigen::Matrix<float,D,Eigen::Dynamic> corners(D, faces.cols());
+
+  for (int f = 0 ; f < n_faces ; f++)
+  {
+    int n_corners = 0;
+    while (n_corners < faces.cols() && faces.coeff(f, n_corners) >= 0)
+    {
+      int v = faces.coeff(f, n_corners);
+      if (v >= vertices.cols())
+        throw std::runtime_error("Error: A face refers to a vertex that does not exist");
+      corners.col(n_corners++) = vertices.col(v);
+    }
+
+    if (n_corners < int(D) || (D == 2 && n_corners > 2))
+      throw std::runtime_error("Error: Every face should have two corners in 2D and at least three in 3D");
+    for (int c = n_corners ; c < faces.cols() ; c++)
+      if (faces.coeff(f, c) >= 0)
+        throw std::runtime_error("Error: The corners of a face should come before the padding");
+
+    walls.push_back(Wall<D>(corners.leftCols(n_corners), abs.col(f), scat.col(f), ""));
+  }
+}
 
 template<>
 void Room<2>::make_shoebox_walls(
@@ -197,6 +274,32 @@ void Room<D>::init()
 
   // Useful for ray tracing
   max_dist = get_max_distance();
+
+  // Build the acceleration structure for wall intersections
+  // In shoebox rooms, the intersections are computed directly
+  obstructing_index.assign(walls.size(), -1);
+  for (size_t i = 0 ; i < obstructing_walls.size() ; i++)
+  {
+    if (obstructing_walls[i] < 0 || obstructing_walls[i] >= int(walls.size()))
+      throw std::runtime_error("Error: The index of an obstructing wall is out of range");
+    obstructing_index[obstructing_walls[i]] = i;
+  }
+
+  if (!is_shoebox)
+    wall_bvh.build(walls);
+
+  // The packed walls follow the leaves of the hierarchy so that every
+  // leaf is tested as one block
+  std::vector<int> order(walls.size());
+  for (size_t i = 0 ; i < walls.size() ; i++)
+    order[i] = i;
+
+  wall_cache.build(walls, is_shoebox ? order : wall_bvh.order());
+  obstructing_cache.build(walls, obstructing_walls);
+
+  wall_hulls.clear();
+  for (auto &wall : walls)
+    wall_hulls.push_back(wall_hull(wall));
 }
 
 
@@ -207,32 +310,116 @@ int Room<D>::image_source_model(const Vectorf<D> &source_location)
    * This is the top-level method to run the image source model
    */
 
-  // make sure the list is empty
-  while (visible_sources.size() > 0)
-    visible_sources.pop();
-
   if (is_shoebox)
   {
+    if (ism_keep_tree)
+    {
+      // the image sources of a shoebox room are found from the source
+      ism_tree = ImageSourceTree<D>();
+      ism_tree.source = source_location;
+      ism_tree.is_shoebox = true;
+    }
+
     return image_source_shoebox(source_location);
   }
   else
   {
-    // add the original (real) source
-    ImageSource<D> real_source(source_location, n_bands);
+    int n_threads = get_num_threads(ism_n_threads);
+
+    if (n_threads > 1 && ism_order > 0)
+    {
+      image_sources_parallel(source_location, n_threads);
+    }
+    else
+    {
+      // start from the original (real) source
+      ism_searches.resize(1);
+      ism_searches[0].init(source_location, n_bands, ism_order);
+      ism_searches[0].record_tree = ism_keep_tree;
+
+      // Run the image source model algorithm
+      image_sources_dfs(ism_searches[0], 0, ism_order);
+    }
 
-    // Run the image source model algorithm
-    image_sources_dfs(real_source, ism_order);
+    if (ism_keep_tree)
+      fill_tree(source_location, ism_searches);
 
     // fill the sources array in room and return
-    return fill_sources();
+    return fill_sources(ism_searches);
   }
 }
 
 
 template<size_t D>
-int Room<D>::fill_sources()
+int Room<D>::image_source_visibility(const ImageSourceTree<D> &tree)
+{
+  /*
+   * Recomputes the visible image sources of a tree kept by a previous run
+   * of the image source model for the current microphones.
+   *
+   * The tree is cut in chunks of consecutive image sources that are
+   * checked in parallel. The path to the first image source of a chunk is
+   * rebuilt from its ancestors, then the paths to the next ones are updated
+   * at the order of each image source, as in the depth first search.
+   */
+  if (tree.is_shoebox)
+    return image_source_shoebox(tree.source);
+
+  if (ism_max_distance > 0.f)
+    throw std::runtime_error("Error: The image sources searched depend on the microphones when ism_max_distance is set");
+
+  if (tree.size() > 0 && size_t(tree.attenuations.rows()) != n_bands)
+    throw std::runtime_error("Error: The image source tree has the wrong number of bands");
+
+  int max_order = tree.size() > 0 ? tree.orders.maxCoeff() : 0;
+  const int chunk_size = 256;
+  size_t n_chunks = (tree.size() + chunk_size - 1) / chunk_size;
+
+  ism_searches.resize(n_chunks);
+
+  parallel_for(n_chunks, get_num_threads(ism_n_threads),
+      [&](size_t c)
+      {
+        ImageSourceSearch<D> &search = ism_searches[c];
+        search.init(tree.source, n_bands, max_order);
+
+        int first = c * chunk_size;
+        int last = std::min(first + chunk_size, int(tree.size()));
+
+        // the ancestors of the first image source of the chunk
+        for (int p = tree.parents[first] ; p >= 0 ; p = tree.parents[p])
+        {
+          int k = tree.orders[p];
+          search.loc[k] = tree.locs.col(p);
+          search.gen_wall[k] = tree.gen_walls[p];
+        }
+
+        for (int i = first ; i < last ; i++)
+        {
+          int k = tree.orders[i];
+          search.loc[k] = tree.locs.col(i);
+          search.gen_wall[k] = tree.gen_walls[i];
+          search.attenuation.col(k) = tree.attenuations.col(i);
+          search.beams[k].clear();  // contains all the microphones
+
+          visit_image_source(search, k);
+        }
+      }
+      );
+
+  return fill_sources(ism_searches);
+}
+
+
+template<size_t D>
+int Room<D>::fill_sources(const std::vector<ImageSourceSearch<D>> &searches)
 {
-  int n_sources = visible_sources.size();
+  /*
+   * Concatenates the image sources found by the searches in the output arrays
+   */
+  int n_sources = 0;
+  for (auto &search : searches)
+    n_sources += search.size();
 
   // Create linear arrays to store the image sources
   if (n_sources > 0)
@@ -244,18 +431,23 @@ int Room<D>::fill_sources()
     attenuations.resize(n_bands, n_sources);
     visible_mics.resize(microphones.size(), n_sources);
 
-    for (int i = n_sources - 1 ; i >= 0 ; i--)
+    int col = 0;
+    for (auto &search : searches)
     {
-      ImageSource<D> &top = visible_sources.top();  // sample top of stack
+      int n = search.size();
+      if (n == 0)
+        continue;
 
-      // fill the arrays
-      sources.col(i) = top.loc;
-      gen_walls.coeffRef(i) = top.gen_wall;
-      orders.coeffRef(i) = top.order;
-      attenuations.col(i) = top.attenuation;
-      visible_mics.col(i) = top.visible_mics;
+      sources.middleCols(col, n) = Eigen::Map<const Eigen::Matrix<float,D,Eigen::Dynamic>>(
+          search.out_loc.data(), D, n);
+      orders.segment(col, n) = Eigen::Map<const Eigen::VectorXi>(search.out_order.data(), n);
+      gen_walls.segment(col, n) = Eigen::Map<const Eigen::VectorXi>(search.out_gen_wall.data(), n);
+      attenuations.middleCols(col, n) = Eigen::Map<const Eigen::MatrixXf>(
+          search.out_attenuation.data(), n_bands, n);
+      visible_mics.middleCols(col, n) = Eigen::Map<const Eigen::Matrix<char,Eigen::Dynamic,Eigen::Dynamic>>(
+          search.out_visible_mics.data(), microphones.size(), n).template cast<bool>();
 
-      visible_sources.pop();  // unstack
+      col += n;
     }
   }
 
@@ -264,160 +456,500 @@ int Room<D>::fill_sources()
 
 
 template<size_t D>
-void Room<D>::image_sources_dfs(ImageSource<D> &is, int max_order)
+void Room<D>::fill_tree(const Vectorf<D> &source, const std::vector<ImageSourceSearch<D>> &searches)
 {
   /*
-   * This function runs a depth first search (DFS) on the tree of image sources
+   * Concatenates the image sources visited by the searches in ism_tree and
+   * links them to their parents. The parent of an image source is the last
+   * one of lower order before it in the order of the depth first search.
    */
+  int n_nodes = 0;
+  for (auto &search : searches)
+    n_nodes += search.tree_order.size();
+
+  ism_tree.source = source;
+  ism_tree.is_shoebox = false;
+  ism_tree.locs.resize(D, n_nodes);
+  ism_tree.attenuations.resize(n_bands, n_nodes);
+  ism_tree.orders.resize(n_nodes);
+  ism_tree.gen_walls.resize(n_nodes);
+  ism_tree.parents.resize(n_nodes);
+
+  int col = 0;
+  for (auto &search : searches)
+  {
+    int n = search.tree_order.size();
+    if (n == 0)
+      continue;
 
-  ImageSource<D> new_is(n_bands);
+    ism_tree.locs.middleCols(col, n) = Eigen::Map<const Eigen::Matrix<float,D,Eigen::Dynamic>>(
+        search.tree_loc.data(), D, n);
+    ism_tree.attenuations.middleCols(col, n) = Eigen::Map<const Eigen::MatrixXf>(
+        search.tree_attenuation.data(), n_bands, n);
+    ism_tree.orders.segment(col, n) = Eigen::Map<const Eigen::VectorXi>(search.tree_order.data(), n);
+    ism_tree.gen_walls.segment(col, n) = Eigen::Map<const Eigen::VectorXi>(search.tree_gen_wall.data(), n);
 
-  // Check the visibility of the source from the different microphones
-  bool any_visible = false;
-  int m = 0;
-  for (auto mic = microphones.begin() ; mic != microphones.end() ; ++mic, ++m)
+    col += n;
+  }
+
+  // the last image source seen at every order
+  std::vector<int> last(ism_order + 1, -1);
+  for (int i = 0 ; i < n_nodes ; i++)
+  {
+    int k = ism_tree.orders[i];
+    ism_tree.parents[i] = k > 0 ? last[k - 1] : -1;
+    last[k] = i;
+  }
+
+  /*
+   * The maps of the image sources are the map of their parent followed by
+   * the reflection across the generating wall, x -> x + 2 (d - n.x) n where
+   * n is the normal of the wall and d = n.origin. They are composed in
+   * double precision.
+   */
+  typedef Eigen::Matrix<double,D,D> MatrixDd;
+  typedef Eigen::Matrix<double,D,1> VectorDd;
+  std::vector<MatrixDd> lin(n_nodes);
+  std::vector<VectorDd> off(n_nodes);
+
+  ism_tree.linear.resize(D * n_nodes, D);
+  ism_tree.offsets.resize(D, n_nodes);
+
+  for (int i = 0 ; i < n_nodes ; i++)
   {
-    bool is_visible = is_visible_dfs(mic->get_loc(), is);
-    if (is_visible && !any_visible)
+    int p = ism_tree.parents[i];
+    if (p < 0)
+    {
+      lin[i].setIdentity();
+      off[i].setZero();
+    }
+    else
     {
-      any_visible = is_visible;
-      is.visible_mics.resize(microphones.size());
-      is.visible_mics.setZero();
+      const Wall<D> &wall = walls[ism_tree.gen_walls[i]];
+      VectorDd n = wall.normal.template cast<double>();
+      double d = n.dot(wall.origin.template cast<double>());
+      MatrixDd householder = MatrixDd::Identity() - 2. * n * n.transpose();
+      lin[i] = householder * lin[p];
+      off[i] = householder * off[p] + 2. * d * n;
     }
-    if (any_visible)
-      is.visible_mics.coeffRef(m) = is_visible;
+
+    ism_tree.linear.middleRows(D * i, D) = lin[i].template cast<float>();
+    ism_tree.offsets.col(i) = off[i].template cast<float>();
   }
 
-  if (any_visible)
-    visible_sources.push(is);  // this should push a copy onto the stack
-  
-  // If we reached maximal depth, stop
-  if (max_order == 0)
-    return;
+  /*
+   * The reflections tested by the search depend on the distances of the
+   * image sources to the walls, the tree is the same for the sources closer
+   * to the source of the search than the smallest margin of the tests. The
+   * beams and the maximum distance depend on more than these distances.
+   */
+  ism_tree.anchor = source;
+  ism_tree.move_radius = 0.f;
+  if (!ism_beam_pruning && ism_max_distance <= 0.f)
+  {
+    float radius = std::numeric_limits<float>::infinity();
+    for (auto &search : searches)
+      radius = std::min(radius, search.tree_radius);
+    // a margin for the rounding errors of the maps
+    ism_tree.move_radius = std::max(0.f, radius - libroom_eps);
+  }
+}
+
 
-  // Then, check all the reflections across the walls
-  for (size_t wi=0 ;  wi < walls.size() ; wi++)
+template<size_t D>
+bool Room<D>::move_image_source_tree(ImageSourceTree<D> &tree, const Vectorf<D> &source) const
+{
+  /*
+   * Maps the source to the image sources of the tree. The visibility of
+   * the moved image sources is then found with image_source_visibility.
+   *
+   * :returns: false, and leaves the tree unchanged, if the source is not
+   *   within move_radius of the source of the search
+   */
+  if (tree.is_shoebox)
   {
-    int dir = walls[wi].reflect(is.loc, new_is.loc);  // the reflected location
+    tree.source = source;
+    return true;
+  }
 
-    // We only check valid reflections (normals should point outward from the room
-    if (dir <= 0)
-      continue;
+  if ((source - tree.anchor).norm() >= tree.move_radius)
+    return false;
 
-    // The reflection is valid, fill in the image source attributes
-    new_is.attenuation = is.attenuation * walls[wi].get_transmission();
-    if (walls[wi].scatter.maxCoeff() > 0.f && is_hybrid_sim)
+  int n_nodes = tree.size();
+  Eigen::VectorXf moved = tree.linear * source;
+  tree.locs = Eigen::Map<const Eigen::Matrix<float,D,Eigen::Dynamic>>(moved.data(), D, n_nodes)
+    + tree.offsets;
+  tree.source = source;
+
+  return true;
+}
+
+
+template<size_t D>
+template<class Func>
+void Room<D>::walk_image_sources(
+    ImageSourceSearch<D> &search,
+    int root,
+    int max_order,
+    const Func &visit
+    )
+{
+  /*
+   * This function runs a depth first search (DFS) on the tree of image
+   * sources below the image source at index root of the path, and calls
+   * visit(k) on every image source found, starting with the root, where
+   * k is the index of the image source in the path.
+   *
+   * The recursion is replaced by the path of search: the image source at
+   * index k is reflected across the walls one after the other and the
+   * search goes down whenever the reflection is valid. The image sources
+   * are visited in the same order as with a recursive search.
+   */
+
+  visit(root);
+  search.next_wall[root] = 0;
+
+  int k = root;
+  while (k >= root)
+  {
+    // If we reached maximal depth, or checked all the walls, go back up
+    if (k == max_order || search.next_wall[k] == int(walls.size()))
     {
-      new_is.attenuation *= (1 - walls[wi].scatter).sqrt();
+      k--;
+      continue;
     }
-    new_is.order = is.order + 1;
-    new_is.gen_wall = wi;
-    new_is.parent = &is;
 
-    // Run the DFS recursion (on the last element in the array, the one we just added)
-    image_sources_dfs(new_is, max_order - 1);
+    // Then, check all the reflections across the walls
+    if (!reflect_image_source(search, k, search.next_wall[k]++))
+      continue;
+
+    // Continue the search below the new image source
+    k++;
+    visit(k);
+    search.next_wall[k] = 0;
   }
 }
 
 
 template<size_t D>
-bool Room<D>::is_visible_dfs(const Vectorf<D> &p, ImageSource<D> &is)
+void Room<D>::image_sources_dfs(ImageSourceSearch<D> &search, int root, int max_order)
 {
   /*
-     Returns true if the given sound source (with image source id) is visible from point p.
-
-     room - the structure that contains all the sources and stuff
-     p (np.array size 2 or 3) coordinates of the point where we check visibility
-     imageId (int) id of the image within the SoundSource object
-     
-     Returns
-     False (0) : not visible
-     True (1) :  visible
-     */
+   * Finds the visible image sources below the image source at index root
+   * of the path, included
+   */
+  walk_image_sources(search, root, max_order,
+      [&](int k) { visit_image_source(search, k); }
+      );
+}
 
-  if (is_obstructed_dfs(p, is))
-    return false;
 
-  if (is.parent != NULL)
+template<size_t D>
+void Room<D>::image_sources_parallel(const Vectorf<D> &source_location, int n_threads)
+{
+  /*
+   * Runs the depth first search of the image sources on several threads.
+   *
+   * The tree is cut below the image sources of order two. Every image
+   * source above the cut and every subtree below it is a task that writes
+   * to its own search. The tasks are listed in the order of the sequential
+   * search and the results concatenated in this order, so that they do not
+   * depend on the number of threads.
+   */
+  int split = std::min(2, ism_order);
+
+  // The tasks are given by the walls generating their image source
+  std::vector<std::vector<int>> task_walls;
+
+  ImageSourceSearch<D> top;
+  top.init(source_location, n_bands, split);
+  top.record_tree = ism_keep_tree;  // only the reflections tested are recorded
+  walk_image_sources(top, 0, split,
+      [&](int k)
+      {
+        task_walls.push_back(std::vector<int>(top.gen_wall.begin() + 1, top.gen_wall.begin() + k + 1));
+      }
+      );
+
+  ism_searches.resize(task_walls.size());
+
+  parallel_for(task_walls.size(), n_threads,
+      [&](size_t t)
+      {
+        ImageSourceSearch<D> &search = ism_searches[t];
+        search.init(source_location, n_bands, ism_order);
+        search.record_tree = ism_keep_tree;
+
+        // rebuild the path to the image source of the task
+        int k = 0;
+        for (int wall_id : task_walls[t])
+          reflect_image_source(search, k++, wall_id);
+
+        if (k < split)
+          visit_image_source(search, k);
+        else
+          image_sources_dfs(search, k, ism_order);
+      }
+      );
+
+  // the reflections tested above the cut are part of the tree too
+  if (ism_searches.size() > 0)
+    ism_searches[0].tree_radius = std::min(ism_searches[0].tree_radius, top.tree_radius);
+}
+
+
+template<size_t D>
+bool Room<D>::reflect_image_source(ImageSourceSearch<D> &search, int k, int wall_id)
+{
+  /*
+   * Reflects the image source at index k of the path across a wall and
+   * stores the new image source at index k + 1.
+   *
+   * :returns: false if the reflection is not valid, or if the new image
+   *   source is farther than ism_max_distance from all the microphones.
+   *   The image sources below it are then farther too, since the path
+   *   from a visible image source to a microphone goes through the wall
+   *   of every image source above it.
+   */
+  const Wall<D> &wall = walls[wall_id];
+
+  int dir = wall.reflect(search.loc[k], search.loc[k + 1]);  // the reflected location
+
+  // The outcome of the test is the same for the image sources of the sources
+  // closer than this to the current one
+  if (search.record_tree)
   {
-    Vectorf<D> intersection;
+    float distance_wall2p = wall.normal.dot(wall.origin - search.loc[k]);
+    search.tree_radius = std::min(search.tree_radius, std::abs(distance_wall2p - libroom_eps));
+  }
 
-    // get generating wall id
-    int wall_id = is.gen_wall;
+  // We only check valid reflections (normals should point outward from the room
+  if (dir <= 0)
+    return false;
 
-    // check if the generating wall is intersected
-    int ret = walls[wall_id].intersection(p, is.loc, intersection);
+  if (!is_in_ism_range(search.loc[k + 1]))
+    return false;
 
-    // The source is not visible if the ray does not intersect
-    // the generating wall
-    if (ret >= 0)
-      // Check visibility of intersection point from parent source
-      return is_visible_dfs(intersection, *(is.parent));
-    else
+  /*
+   * The reflection points on the wall are in the beam of the image source
+   * at index k. The part of the wall inside the beam is the aperture of the
+   * new image source, if it is empty no path goes through it.
+   */
+  if (ism_beam_pruning)
+  {
+    Beam<D> &beam = search.beams[k + 1];
+    if (!search.beams[k].clip(wall_hulls[wall_id], beam.aperture, search.clip_buffer))
       return false;
+    beam.build(search.loc[k + 1], wall, 10.f * libroom_eps);
+  }
+
+  // The reflection is valid, fill in the image source attributes
+  search.attenuation.col(k + 1) = search.attenuation.col(k) * wall.get_transmission();
+  if (wall.scatter.maxCoeff() > 0.f && is_hybrid_sim)
+  {
+    search.attenuation.col(k + 1) *= (1 - wall.scatter).sqrt();
   }
+  search.gen_wall[k + 1] = wall_id;
 
-  // If we get here this is the original, unobstructed, source
   return true;
 }
 
 
 template<size_t D>
-bool Room<D>::is_obstructed_dfs(const Vectorf<D> &p, ImageSource<D> &is)
+void Room<D>::visit_image_source(ImageSourceSearch<D> &search, int k)
+{
+  /*
+   * Checks the visibility of the image source at index k of the path from
+   * the different microphones and keeps it if any of them sees it, within
+   * ism_max_distance if set. The image source is added to the tree of the
+   * search first when it is recorded.
+   */
+  if (search.record_tree)
+  {
+    for (size_t d = 0 ; d < D ; d++)
+      search.tree_loc.push_back(search.loc[k][d]);
+    for (size_t b = 0 ; b < n_bands ; b++)
+      search.tree_attenuation.push_back(search.attenuation.coeff(b, k));
+    search.tree_order.push_back(k);
+    search.tree_gen_wall.push_back(search.gen_wall[k]);
+  }
+
+  size_t n_mics = microphones.size();
+  size_t first = search.out_visible_mics.size();
+  search.out_visible_mics.resize(first + n_mics);
+
+  char *visible = search.out_visible_mics.data() + first;
+  visible_mics_dfs(search, k, visible);
+
+  bool any_visible = false;
+  for (size_t m = 0 ; m < n_mics ; m++)
+    any_visible |= visible[m] && is_in_ism_range(search.loc[k], m);
+
+  if (!any_visible)
+  {
+    search.out_visible_mics.resize(first);
+    return;
+  }
+
+  for (size_t d = 0 ; d < D ; d++)
+    search.out_loc.push_back(search.loc[k][d]);
+  for (size_t b = 0 ; b < n_bands ; b++)
+    search.out_attenuation.push_back(search.attenuation.coeff(b, k));
+  search.out_order.push_back(k);
+  search.out_gen_wall.push_back(search.gen_wall[k]);
+}
+
+
+template<size_t D>
+bool Room<D>::is_in_ism_range(const Vectorf<D> &loc, int mic_id) const
+{
+  /*
+   * Checks that an image source is within ism_max_distance of microphone
+   * mic_id, or of any microphone if mic_id is -1. Always true if there is
+   * no maximum distance or no microphone.
+   */
+  if (ism_max_distance <= 0.f || microphones.size() == 0)
+    return true;
+
+  float max_dist_sq = ism_max_distance * ism_max_distance;
+
+  if (mic_id >= 0)
+    return (loc - microphones[mic_id].get_loc()).squaredNorm() <= max_dist_sq;
+
+  for (auto &mic : microphones)
+    if ((loc - mic.get_loc()).squaredNorm() <= max_dist_sq)
+      return true;
+
+  return false;
+}
+
+
+template<size_t D>
+void Room<D>::visible_mics_dfs(ImageSourceSearch<D> &search, int k, char *visible)
+{
+  /*
+   * Checks the visibility of the image source at index k of the path from
+   * all the microphones at once.
+   *
+   * The path is walked once from the image source up to the real source.
+   * At every image source, the points where the rays from the microphones
+   * hit the generating wall become the new end points of the rays, and the
+   * microphones whose ray is obstructed or misses the wall are dropped from
+   * the list of active microphones. The walk stops early when none is left.
+   *
+   * search - the path of image sources
+   * k (int) index of the image source in the path
+   * visible (char *) set to 1 for the microphones that see the image
+   *   source and 0 for the others, n_mics values
+   */
+  size_t n_mics = microphones.size();
+  search.mic_points.resize(n_mics);
+  search.mic_active.clear();
+
+  for (size_t m = 0 ; m < n_mics ; m++)
+  {
+    const Vectorf<D> &mic = microphones[m].get_loc();
+
+    // With ism_beam_pruning, the microphones outside the beam of the
+    // image source cannot see it
+    visible[m] = !ism_beam_pruning || search.beams[k].contains(mic);
+    if (visible[m])
+    {
+      search.mic_points[m] = mic;
+      search.mic_active.push_back(m);
+    }
+  }
+
+  Vectorf<D> intersection;
+
+  for ( ; k > 0 && search.mic_active.size() > 0 ; k--)
+  {
+    const Wall<D> &gen_wall = walls[search.gen_wall[k]];
+    size_t n_active = 0;
+
+    for (auto m : search.mic_active)
+    {
+      Vectorf<D> &point = search.mic_points[m];
+
+      // The ray must not be obstructed and must intersect the generating wall
+      if (is_obstructed_dfs(point, search, k)
+          || gen_wall.intersection(point, search.loc[k], intersection) < 0)
+      {
+        visible[m] = 0;
+        continue;
+      }
+
+      // Check visibility of intersection point from parent source
+      point = intersection;
+      search.mic_active[n_active++] = m;
+    }
+
+    search.mic_active.resize(n_active);
+  }
+
+  // If we get here this is the original source, visible if unobstructed
+  for (auto m : search.mic_active)
+    if (is_obstructed_dfs(search.mic_points[m], search, 0))
+      visible[m] = 0;
+}
+
+
+template<size_t D>
+bool Room<D>::is_obstructed_dfs(const Vectorf<D> &p, const ImageSourceSearch<D> &search, int k)
 {
   /*
      Checks if there is a wall obstructing the line of sight going from a source to a point.
 
-     room - the structure that contains all the sources and stuff
      p (np.array size 2 or 3) coordinates of the point where we check obstruction
-     imageId (int) id of the image within the SoundSource object
+     search - the path of image sources
+     k (int) index of the image source in the path
 
      Returns (bool)
      False (0) : not obstructed
      True (1) :  obstructed
      */
-  int gen_wall_id = is.gen_wall;
+  int gen_wall_id = search.gen_wall[k];
+  const Vectorf<D> &loc = search.loc[k];
 
   // Check candidate walls for obstructions
-  for (size_t ow = 0 ; ow < obstructing_walls.size() ; ow++)
-  {
-    int wall_id = obstructing_walls[ow];
-
-    // generating wall can't be obstructive
-    if (wall_id != gen_wall_id)
-    {
-      Vectorf<D> intersection;
-      int ret = walls[wall_id].intersection(is.loc, p, intersection);
-
-      // There is an intersection and it is distinct from segment endpoints
-      if (ret == Wall<D>::Isect::VALID || ret == Wall<D>::Isect::BNDRY)
+  return obstructing_cache.intersect(loc, p, 0, obstructing_cache.size(),
+      [&](int wall_id, int ret, const Vectorf<D> &intersection)
       {
-        if (is.parent != NULL)
+        // generating wall can't be obstructive
+        if (wall_id == gen_wall_id)
+          return false;
+
+        // There is an intersection and it is distinct from segment endpoints
+        if (ret == Wall<D>::Isect::VALID || ret == Wall<D>::Isect::BNDRY)
         {
-          // Test if the intersection point and the image are on
-          // opposite sides of the generating wall 
-          // We ignore the obstruction if it is inside the
-          // generating wall (it is what happens in a corner)
-          int img_side = walls[is.gen_wall].side(is.loc);
-          int intersection_side = walls[is.gen_wall].side(intersection);
-
-          if (img_side != intersection_side && intersection_side != 0)
+          if (k > 0)
+          {
+            // Test if the intersection point and the image are on
+            // opposite sides of the generating wall 
+            // We ignore the obstruction if it is inside the
+            // generating wall (it is what happens in a corner)
+            int img_side = walls[gen_wall_id].side(loc);
+            int intersection_side = walls[gen_wall_id].side(intersection);
+
+            return img_side != intersection_side && intersection_side != 0;
+          }
+          else
             return true;
         }
-        else
-          return true;
-      }
-    }
-  }
 
-  return false;
+        return false;
+      }
+      );
 }
 
 
 template<size_t D>
-int Room<D>::image_source_shoebox(const Vectorf<D> &source)
+std::vector<Eigen::ArrayXXf> Room<D>::shoebox_transmission() const
 {
-  // precompute powers of the transmission coefficients
+  /*
+   * The powers 0, ..., ism_order of the transmission coefficients of the
+   * walls of the shoebox, n_bands x (2 * D) each
+   */
   std::vector<Eigen::ArrayXXf> transmission_pwr;
   for (int i(0) ; i <= ism_order ; ++i)
     transmission_pwr.push_back(Eigen::ArrayXXf(n_bands, 2*D));
@@ -434,89 +966,221 @@ int Room<D>::image_source_shoebox(const Vectorf<D> &source)
   for (int i = 2 ; i <= ism_order ; ++i)
     transmission_pwr[i] = transmission_pwr[i-1] * transmission_pwr[1];
 
-  // make sure the list is empty
-  int n_image_sources = number_image_sources_3(ism_order);
-  if (D == 2)
-    n_image_sources = number_image_sources_2(ism_order);
+  return transmission_pwr;
+}
 
-  std::vector<ImageSource<D>> image_sources(n_image_sources, ImageSource<D>(n_bands));
-  int img_src_index = 0;
-  
-  // L1 ball of room images
-  int point[3] = {0, 0, 0};
+
+template<size_t D>
+int Room<D>::shoebox_rows(const Vectorf<D> &source, std::vector<ShoeboxRow> &rows) const
+{
+  /*
+   * Lists the rows along the x axis of the discrete L1 ball of radius
+   * ism_order of the images of a shoebox room, with the position of their
+   * first image when all the images are stored one after the other.
+   *
+   * With a maximum distance, the rows of images too far from the box
+   * containing the microphones are skipped, and the ends of the rows too.
+   * The distance to the box is only a lower bound and the remaining images
+   * should still be checked with is_in_ism_range.
+   *
+   * :returns: the number of images in the rows
+   */
+  bool bounded = ism_max_distance > 0.f && microphones.size() > 0;
+  float max_dist_sq = ism_max_distance * ism_max_distance;
+  Vectorf<D> mic_min, mic_max;
+  mic_min.setZero();
+  mic_max.setZero();
+  if (bounded)
+  {
+    mic_min = microphones[0].get_loc();
+    mic_max = microphones[0].get_loc();
+    for (auto &mic : microphones)
+    {
+      mic_min = mic_min.cwiseMin(mic.get_loc());
+      mic_max = mic_max.cwiseMax(mic.get_loc());
+    }
+  }
+
+  // squared distance from the images with reflection index p along
+  // axis d to the box of the microphones, along this axis
+  auto gap_sq = [&](int d, int p)
+  {
+    if (!bounded || d >= int(D))
+      return 0.f;
+    float step = abs(p) % 2 == 1 ? shoebox_size.coeff(d) - source.coeff(d) : source.coeff(d);
+    float x = p * shoebox_size.coeff(d) + step;
+    float gap = std::max(std::max(mic_min[d] - x, x - mic_max[d]), 0.f);
+    return gap * gap;
+  };
 
   // Take 2D case into account
   int z_max = ism_order;
   if (D == 2)
     z_max = 0;
 
-  // Walk on all the points of the discrete L! ball of radius ism_order
-  for (point[2] = -z_max ; point[2] <= z_max ; point[2]++)
+  rows.clear();
+  int n_image_sources = 0;
+  for (int z = -z_max ; z <= z_max ; z++)
   {
-    int y_max = ism_order - abs(point[2]);
-    for (point[1] = -y_max ; point[1] <= y_max ; point[1]++)
+    float gap_z = gap_sq(2, z);
+    if (gap_z > max_dist_sq && bounded)
+      continue;
+
+    int y_max = ism_order - abs(z);
+    for (int y = -y_max ; y <= y_max ; y++)
     {
-      int x_max = y_max - abs(point[1]);
+      float gap_yz = gap_z + gap_sq(1, y);
+      if (gap_yz > max_dist_sq && bounded)
+        continue;
+
+      int x_max = y_max - abs(y);
       if (x_max < 0) x_max = 0;
 
-      for (point[0] = -x_max ; point[0] <= x_max ; point[0]++)
+      // the images of the row in range of the box of the microphones
+      int x_min = -x_max;
+      while (x_min <= x_max && gap_yz + gap_sq(0, x_min) > max_dist_sq && bounded)
+        x_min++;
+      while (x_max >= x_min && gap_yz + gap_sq(0, x_max) > max_dist_sq && bounded)
+        x_max--;
+      if (x_min > x_max)
+        continue;
+
+      rows.push_back({ z, y, x_min, x_max, n_image_sources });
+      n_image_sources += x_max - x_min + 1;
+    }
+  }
+
+  return n_image_sources;
+}
+
+
+template<size_t D>
+int Room<D>::shoebox_image(
+    const Vectorf<D> &source,
+    const int *point,
+    const std::vector<Eigen::ArrayXXf> &transmission_pwr,
+    Eigen::Ref<Vectorf<D>> loc,
+    Eigen::Ref<Eigen::VectorXf> attenuation
+    ) const
+{
+  /*
+   * Computes the location and attenuation of the image of a shoebox room
+   * with reflection indices point[0], ..., point[D - 1]
+   *
+   * :returns: the order of the image
+   */
+  int order = 0;
+  attenuation.setOnes();
+
+  // Now compute the reflection, the order, and the multiplicative constant
+  for (size_t d = 0 ; d < D ; d++)
+  {
+    // Compute the reflected source
+    float step = abs(point[d]) % 2 == 1 ? shoebox_size.coeff(d) - source.coeff(d) : source.coeff(d);
+    loc[d] = point[d] * shoebox_size.coeff(d) + step;
+
+    // source order is just the sum of absolute values of reflection indices
+    order += abs(point[d]);
+
+    // attenuation can also be computed this way
+    int p1 = 0, p2 = 0;
+    if (point[d] > 0)
+    {
+      p1 = point[d]/2; 
+      p2 = (point[d]+1)/2;
+    }
+    else if (point[d] < 0)
+    {
+      p1 = abs((point[d]-1)/2);
+      p2 = abs(point[d]/2);
+    }
+    attenuation.array() *= transmission_pwr[p1].col(2*d);  // 'west' absorption factor
+    attenuation.array() *= transmission_pwr[p2].col(2*d+1);  // 'east' absorption factor
+  }
+
+  return order;
+}
+
+
+template<size_t D>
+int Room<D>::image_source_shoebox(const Vectorf<D> &source)
+{
+  // precompute powers of the transmission coefficients
+  std::vector<Eigen::ArrayXXf> transmission_pwr = shoebox_transmission();
+
+  /*
+   * The images of the L1 ball of radius ism_order are walked by rows along
+   * the x axis. The rows are listed first, with the position of their
+   * first image in the output arrays, so that they are then filled
+   * independently, in parallel.
+   */
+  std::vector<ShoeboxRow> rows;
+  int n_image_sources = shoebox_rows(source, rows);
+  bool bounded = ism_max_distance > 0.f && microphones.size() > 0;
+
+  sources.resize(D, n_image_sources);
+  orders.resize(n_image_sources);
+  orders_xyz.resize(D, n_image_sources);
+  gen_walls.resize(n_image_sources);
+  attenuations.resize(n_bands, n_image_sources);
+  visible_mics.resize(microphones.size(), n_image_sources);
+
+  gen_walls.setConstant(-1);
+  visible_mics.setOnes();  // everything is visible
+
+  // the images out of range are flagged in a separate array so that
+  // the rows can be compacted afterwards
+  std::vector<char> keep;
+  if (bounded)
+    keep.resize(n_image_sources);
+
+  parallel_for(rows.size(), ism_n_threads,
+      [&](size_t r)
       {
-        ImageSource<D> &is = image_sources[img_src_index++];
-        is.visible_mics.resize(microphones.size());
-        is.visible_mics.setOnes();  // everything is visible
+        const ShoeboxRow &row = rows[r];
+        int point[3] = { 0, row.y, row.z };
 
-        // Now compute the reflection, the order, and the multiplicative constant
-        for (size_t d = 0 ; d < D ; d++)
+        for (point[0] = row.x_min ; point[0] <= row.x_max ; point[0]++)
         {
-          // Compute the reflected source
-          float step = abs(point[d]) % 2 == 1 ? shoebox_size.coeff(d) - source.coeff(d) : source.coeff(d);
-          is.loc[d] = point[d] * shoebox_size.coeff(d) + step;
-          is.order_xyz[d] = point[d];
+          int idx = row.first + point[0] - row.x_min;
 
-          // source order is just the sum of absolute values of reflection indices
-          is.order += abs(point[d]);
+          orders.coeffRef(idx) = shoebox_image(source, point, transmission_pwr,
+              sources.col(idx), attenuations.col(idx));
+          for (size_t d = 0 ; d < D ; d++)
+            orders_xyz.coeffRef(d, idx) = point[d];
 
-          // attenuation can also be computed this way
-          int p1 = 0, p2 = 0;
-          if (point[d] > 0)
-          {
-            p1 = point[d]/2; 
-            p2 = (point[d]+1)/2;
-          }
-          else if (point[d] < 0)
-          {
-            p1 = abs((point[d]-1)/2);
-            p2 = abs(point[d]/2);
-          }
-          is.attenuation *= transmission_pwr[p1].col(2*d);  // 'west' absorption factor
-          is.attenuation *= transmission_pwr[p2].col(2*d+1);  // 'east' absorption factor
+          // the distance to the box of the microphones is only a lower bound
+          if (bounded)
+            keep[idx] = is_in_ism_range(sources.col(idx));
         }
       }
-    }
-  }
+      );
 
-  // Create linear arrays to store the image sources
-  if (n_image_sources > 0)
+  if (bounded)
   {
-    // resize all the arrays
-    sources.resize(D, n_image_sources);
-    orders.resize(n_image_sources);
-    orders_xyz.resize(D, n_image_sources);
-    gen_walls.resize(n_image_sources);
-    attenuations.resize(n_bands, n_image_sources);
-    visible_mics.resize(microphones.size(), n_image_sources);
-
-    for (std::vector<int>::size_type idx = 0; idx < image_sources.size(); ++idx) {
-      ImageSource<D> &top = image_sources[idx];  // sample top of stack
-
-      // fill the arrays
-      sources.col(idx) = top.loc;
-      gen_walls.coeffRef(idx) = top.gen_wall;
-      orders.coeffRef(idx) = top.order;
-      orders_xyz.col(idx) = top.order_xyz;
-      attenuations.col(idx) = top.attenuation;
-      visible_mics.col(idx) = top.visible_mics;
+    // move the images in range to the front, in order
+    int n_kept = 0;
+    for (int idx = 0 ; idx < n_image_sources ; idx++)
+    {
+      if (!keep[idx])
+        continue;
+      if (n_kept < idx)
+      {
+        sources.col(n_kept) = sources.col(idx);
+        orders.coeffRef(n_kept) = orders.coeff(idx);
+        orders_xyz.col(n_kept) = orders_xyz.col(idx);
+        attenuations.col(n_kept) = attenuations.col(idx);
+      }
+      n_kept++;
     }
+
+    n_image_sources = n_kept;
+    sources.conservativeResize(D, n_image_sources);
+    orders.conservativeResize(n_image_sources);
+    orders_xyz.conservativeResize(D, n_image_sources);
+    gen_walls.conservativeResize(n_image_sources);
+    attenuations.conservativeResize(n_bands, n_image_sources);
+    visible_mics.conservativeResize(microphones.size(), n_image_sources);
   }
 
   // return number images
@@ -524,6 +1188,95 @@ int Room<D>::image_source_shoebox(const Vectorf<D> &source)
 }
 
 
+template<size_t D>
+std::vector<RowArrayXXd> Room<D>::shoebox_rir(
+    const Vectorf<D> &source,
+    double fs,
+    double c,
+    int fdl,
+    int lut_gran,
+    int length
+    )
+{
+  /*
+   * Builds the part of the impulse responses of a shoebox room due to the
+   * image sources, without storing the image sources.
+   *
+   * The lattice of images is walked once per microphone to find the length
+   * of the response, and once more to add the fractional delay filter of
+   * every image to the response of every band with RirBuilder. The memory
+   * used is the size of the responses.
+   *
+   * source: the location of the source
+   * fs: the sampling frequency
+   * c: the speed of sound
+   * fdl: the length of the fractional delay filter (odd)
+   * lut_gran: the number of point per unit in the sinc interpolation table
+   * length: if positive, the length of the responses, the images whose
+   *   filter does not fit are left out
+   *
+   * :returns: one n_bands x (N + fdl) array per microphone, where N is the
+   *   delay of the farthest image in samples, or n_bands x length
+   */
+  if (!is_shoebox)
+    throw std::runtime_error("Error: The fused image source model is only available for shoebox rooms");
+
+  RirBuilder builder(fdl, lut_gran);
+
+  std::vector<Eigen::ArrayXXf> transmission_pwr = shoebox_transmission();
+  std::vector<ShoeboxRow> rows;
+  shoebox_rows(source, rows);
+  bool bounded = ism_max_distance > 0.f && microphones.size() > 0;
+
+  std::vector<RowArrayXXd> rirs(microphones.size());
+
+  parallel_for(microphones.size(), ism_n_threads,
+      [&](size_t m)
+      {
+        Eigen::Matrix<double, D, 1> mic = microphones[m].get_loc().template cast<double>();
+        Vectorf<D> loc;
+        Eigen::VectorXf attenuation(n_bands);
+
+        RowArrayXXd &rir = rirs[m];
+        double dist_max = 0.;
+
+        // The images in range are walked twice, to find the length of the
+        // response and then to add their filters to it
+        for (int pass = (length > 0 ? 1 : 0) ; pass < 2 ; pass++)
+        {
+          if (pass == 1)
+            rir.setZero(n_bands, length > 0 ? length : builder.min_length(dist_max / c, fs));
+
+          for (auto &row : rows)
+          {
+            int point[3] = { 0, row.y, row.z };
+            for (point[0] = row.x_min ; point[0] <= row.x_max ; point[0]++)
+            {
+              shoebox_image(source, point, transmission_pwr, loc, attenuation);
+              if (bounded && !is_in_ism_range(loc))
+                continue;
+
+              double dist = (loc.template cast<double>() - mic).norm();
+              if (pass == 0)
+              {
+                dist_max = std::max(dist_max, dist);
+                continue;
+              }
+
+              if (builder.min_length(dist / c, fs) > rir.cols())
+                continue;
+
+              builder.add(rir, dist / c, fs, attenuation.array().template cast<double>() / dist);
+            }
+          }
+        }
+      }
+      );
+
+  return rirs;
+}
+
+
 template<size_t D>
 float Room<D>::get_max_distance()
 {
@@ -721,40 +1474,79 @@ next_plane:
     // 'start'. That's why we need a min_dist variable
     // Upperbound on the min distance that we could find
 
-    // For a scattered ray, we only check the obstructing walls
-    size_t n_walls = scattered_ray ? obstructing_walls.size() : walls.size();
+    // The candidate walls are found with the bounding volume hierarchy.
+    // Since the walls are not visited in order, ties are broken with
+    // the wall index to get the same result as a linear scan.
+    // The walls of a leaf are tested together on the packed copy.
+    wall_bvh.intersect(start, end, hit_dist,
+        [&](int first, int count)
+        {
+          return wall_cache.intersect(start, end, first, count,
+              [&](int wall_id, int, const Vectorf<D> &temp_hit)
+              {
+                // For a scattered ray, we only check the obstructing walls
+                int i = scattered_ray ? obstructing_index[wall_id] : wall_id;
+                if (i < 0)
+                  return false;
+
+                float temp_dist = (temp_hit - start).norm();
+
+                // Compare to min dist to see if this wall is the closest to 'start'
+                // Compare to libroom_eps to be sure that this wall w is not the wall
+                //   where 'start' is located ('intersects' could be true because of
+                //   rounding errors)
+                if (temp_dist > libroom_eps
+                    && (temp_dist < hit_dist || (temp_dist == hit_dist && i < next_wall_index)))
+                {
+                  hit_dist = temp_dist;
+                  result = temp_hit;
+                  next_wall_index = i;
+                }
+
+                return false;
+              }
+              );
+        }
+        );
 
-    for (size_t i(0) ; i < n_walls ; ++i)
-    {
-      Wall<D> & w = scattered_ray ? walls[obstructing_walls[i]] : walls[i];
+  }
 
-      // To store the result of this iteration
-      Vectorf<D> temp_hit;
+  return std::make_tuple(result, next_wall_index, hit_dist);
 
-      // As a side effect, temp_hit gets a value (VectorXf) here
-      int ret = w.intersection(start, end, temp_hit);
+}
 
-      if (ret > -1)
-      {
-        float temp_dist = (temp_hit - start).norm();
 
-        // Compare to min dist to see if this wall is the closest to 'start'
-        // Compare to libroom_eps to be sure that this wall w is not the wall
-        //   where 'start' is located ('intersects' could be true because of
-        //   rounding errors)
-        if (temp_dist > libroom_eps && temp_dist < hit_dist)
-        {
-          hit_dist = temp_dist;
-          result = temp_hit;
-          next_wall_index = i;
-        }
-      }
-    }
+template<size_t D>
+bool Room<D>::is_obstructed(const Vectorf<D> &start, const Vectorf<D> &end)
+{
+  /*
+   * Any-hit version of next_wall_hit for scattered rays. Returns true as soon
+   * as one of the obstructing walls intersects the segment (start, end).
+   */
+  bool obstructed = false;
 
-  }
+  if (obstructing_walls.size() == 0)
+    return false;
 
-  return std::make_tuple(result, next_wall_index, hit_dist);
+  wall_bvh.intersect(start, end, max_dist,
+      [&](int first, int count)
+      {
+        return wall_cache.intersect(start, end, first, count,
+            [&](int wall_id, int, const Vectorf<D> &temp_hit)
+            {
+              if (obstructing_index[wall_id] < 0)
+                return false;
+
+              float temp_dist = (temp_hit - start).norm();
+              obstructed = libroom_eps < temp_dist && temp_dist < max_dist;
+
+              return obstructed;
+            }
+            );
+      }
+      );
 
+  return obstructed;
 }
 
 
@@ -767,6 +1559,22 @@ bool Room<D>::scat_ray(
     float travel_dist
     )
 {
+  return scat_ray_impl<Eigen::Dynamic>(transmitted, wall, -1, prev_last_hit, hit_point, travel_dist, microphones);
+}
+
+
+template<size_t D>
+template<int B>
+bool Room<D>::scat_ray_impl(
+    const Arrayf<B> &transmitted,
+    const Wall<D> &wall,
+    int wall_id,
+    const Vectorf<D> &prev_last_hit,
+    const Vectorf<D> &hit_point,
+    float travel_dist,
+    std::vector<Microphone<D>> &receivers
+    )
+{
 
   /*
     Traces a one-hop scattered ray from the last wall hit to each microphone.
@@ -776,10 +1584,13 @@ bool Room<D>::scat_ray(
     float energy: The energy of the ray right after last_wall has absorbed
       a part of it
     wall: The wall object where last_hit is located
+    wall_id: The index of the wall, used to look up the visibility of the
+      microphones when the table is built, or -1
     prev_last_hit: (array size 2 or 3) the previous last wall hit_point position (needed to check that 
       the wall normal is correctly oriented)
     hit_point: (array size 2 or 3) defines the last wall hit position
     travel_dist: The total distance travelled by the ray from source to hit_point
+    receivers: The microphones where the hits are logged
 
   :return : true if the scattered ray reached ALL the microphones, false otw
   */
@@ -787,32 +1598,35 @@ bool Room<D>::scat_ray(
   // Convert the energy threshold to transmission threshold (make this more efficient at some point)
   float distance_thres = time_thres * sound_speed;
 
+  bool use_table = wall_id >= 0 && !patch_visibility.empty();
+  int prev_side = wall.side(prev_last_hit);
+
   bool ret = true;  
-  for(size_t k(0); k < microphones.size(); ++k)
+  for(size_t k(0); k < receivers.size(); ++k)
   {
 
-    Vectorf<D> mic_pos = microphones[k].get_loc();
+    Vectorf<D> mic_pos = receivers[k].get_loc();
 
     /* 
      * We also need to check that both the microphone and the
      * previous hit point are on the same side of the wall
      */
-    if (wall.side(mic_pos) != wall.side(prev_last_hit))
+    int mic_side = use_table ? patch_visibility.side(wall_id, k) : wall.side(mic_pos);
+    if (mic_side != prev_side)
     {
       ret = false;
       continue;
     }
 
-    // Prepare the output tupple of next_wall_hit()
-    Vectorf<D> dont_care;
-    int next_wall_index(-1);
-    float hit_distance(0.);
-
-    if (!is_shoebox)
-      std::tie(dont_care, next_wall_index, hit_distance) = next_wall_hit(hit_point, mic_pos, true);
+    // The visibility table gives the answer, except close to the
+    // boundary of the shadows
+    int state = PatchVisibility<D>::UNKNOWN;
+    if (!is_shoebox && use_table)
+      state = patch_visibility.state(wall_id, hit_point, k);
 
     // If no wall obstructs the scattered ray
-    if (next_wall_index == -1)
+    if (is_shoebox || state == PatchVisibility<D>::VISIBLE
+        || (state == PatchVisibility<D>::UNKNOWN && !is_obstructed(hit_point, mic_pos)))
     {
       // As the ray is shot towards the microphone center,
       // the hop dist can be easily computed
@@ -826,7 +1640,7 @@ bool Room<D>::scat_ray(
       // cosine angle should be positive, but could be negative if normal is
       // facing out of room so we take abs
       float p_lambert = 2 * std::abs(wall.cosine_angle(hit_point_to_mic));
-      Eigen::ArrayXf scat_trans = wall.scatter * transmitted * p_hit_equal * p_lambert;
+      Arrayf<B> scat_trans = wall.scatter * transmitted * p_hit_equal * p_lambert;
 
       // We add an entry to output and we increment the right element
       // of scat_per_slot
@@ -837,8 +1651,8 @@ bool Room<D>::scat_ray(
         //microphones[k].log_histogram(output[k].back(), hit_point);
         double r_sq = double(travel_dist_at_mic) * travel_dist_at_mic;
         auto p_hit = (1 - sqrt(1 - mic_radius_sq / std::max(mic_radius_sq, r_sq)));
-        Eigen::ArrayXf energy = scat_trans / (r_sq * p_hit) ;
-        microphones[k].log_histogram(travel_dist_at_mic, energy, hit_point);
+        Arrayf<B> energy = scat_trans / (r_sq * p_hit) ;
+        receivers[k].log_histogram(travel_dist_at_mic, energy, hit_point);
       }
       else
         ret = false;
@@ -849,9 +1663,38 @@ bool Room<D>::scat_ray(
     }
   }
 
-  return ret;
+  return ret;
+}
+
+template<size_t D>
+void Room<D>::prepare_receivers(const std::vector<Microphone<D>> &receivers)
+{
+  /*
+   * Builds the structures over the receivers used by the ray tracing
+   *
+   * - the hierarchy of the boxes around the receivers used to find the
+   *   specular hits. The boxes are padded like the ones of the walls.
+   * - the visibility table of the scattered rays, when enabled. It is
+   *   only built again when the receivers have changed.
+   */
+  float pad = mic_radius + std::max(1e-3f, 10.f * libroom_eps);
+
+  std::vector<Vectorf<D>> r_min(receivers.size()), r_max(receivers.size());
+  for (size_t k = 0 ; k < receivers.size() ; k++)
+  {
+    r_min[k] = receivers[k].get_loc().array() - pad;
+    r_max[k] = receivers[k].get_loc().array() + pad;
+  }
+
+  receiver_bvh.build(r_min, r_max, pad);
+
+  if (is_shoebox || visibility_patch_size <= 0.f)
+    patch_visibility.clear();
+  else if (!patch_visibility.is_built_for(receivers, visibility_patch_size))
+    patch_visibility.build(walls, obstructing_walls, receivers, visibility_patch_size, n_threads);
 }
 
+
 template<size_t D>
 void Room<D>::simul_ray(
     float phi,
@@ -860,6 +1703,21 @@ void Room<D>::simul_ray(
     float energy_0
     )
 {
+  prepare_receivers(microphones);
+  simul_ray_impl<Eigen::Dynamic>(phi, theta, source_pos, energy_0, microphones);
+}
+
+
+template<size_t D>
+template<int B>
+void Room<D>::simul_ray_impl(
+    float phi,
+    float theta,
+    const Vectorf<D> &source_pos,
+    float energy_0,
+    std::vector<Microphone<D>> &receivers
+    )
+{
 
   /*This function simulates one ray and fills the output vectors of 
    every microphone with all the entries produced by this ray
@@ -868,7 +1726,7 @@ void Room<D>::simul_ray(
    phi (azimuth) and theta (colatitude) : give the orientation of the ray (2D or 3D)
    source_pos: (array size 2 or 3) is the location of the sound source (NOT AN IMAGE SOURCE)
   energy_0: (float) the initial energy of one ray
-   output: is the std::vector that contains the entries for all the simulated rays */
+   receivers: the microphones where the entries produced by the ray are logged */
 
   // ------------------ INIT --------------------
   // What we need to trace the ray
@@ -886,8 +1744,8 @@ void Room<D>::simul_ray(
   int next_wall_index(0);
 
   // The ray's characteristics
-  Eigen::ArrayXf transmitted = Eigen::ArrayXf::Ones(n_bands) * energy_0;
-  Eigen::ArrayXf energy = Eigen::ArrayXf::Ones(n_bands);
+  Arrayf<B> transmitted = Arrayf<B>::Ones(n_bands) * energy_0;
+  Arrayf<B> energy = Arrayf<B>::Ones(n_bands);
   float travel_dist = 0;
   
   // To count the number of times the ray bounces on the walls
@@ -921,37 +1779,7 @@ void Room<D>::simul_ray(
 
     // Check if the specular ray hits any of the microphone
     if (!(is_hybrid_sim && specular_counter < ism_order))
-    {
-      for(size_t k(0) ; k < microphones.size() ; k++)
-      {
-        // Compute the distance between the line defined by (start, hit_point)
-        // and the center of the microphone (mic_pos)
-        Vectorf<D> to_mic = microphones[k].get_loc() - start;
-        float impact_distance = to_mic.dot(dir);
-
-        bool impacts = -libroom_eps < impact_distance && impact_distance < hit_distance + libroom_eps;
-
-        // If yes, we compute the ray's transmitted amplitude at the mic
-        // and we continue the ray
-        if (impacts &&
-            (to_mic - dir * impact_distance).norm() < mic_radius + libroom_eps)
-        {
-          // The length of this last hop
-          float distance = fabsf(impact_distance);
-
-          // Updating travel_time and transmitted amplitude for this ray
-          // We DON'T want to modify the variables transmitted amplitude and travel_dist
-          //   because the ray will continue its way          
-          float travel_dist_at_mic = travel_dist + distance;
-
-          double r_sq = double(travel_dist_at_mic) * travel_dist_at_mic;
-          auto p_hit = (1 - sqrt(1 - mic_radius_sq / std::max(mic_radius_sq, r_sq)));
-          energy = transmitted / (r_sq * p_hit);
-          // energy = transmitted / (travel_dist_at_mic - sqrtf(fmaxf(0.f, travel_dist_at_mic * travel_dist_at_mic - mic_radius_sq)));
-          microphones[k].log_histogram(travel_dist_at_mic, energy, start);
-        }
-      }
-    }
+      log_specular_hits(start, dir, hit_distance, travel_dist, transmitted, energy, receivers);
 
     // Update the characteristics
     travel_dist += hit_distance;
@@ -961,12 +1789,14 @@ void Room<D>::simul_ray(
     if (wall.scatter.maxCoeff() > 0.f)
     {
       // Shoot the scattered ray
-      scat_ray(
+      scat_ray_impl(
           transmitted,
           wall,
+          next_wall_index,
           start,
           hit_point,
-          travel_dist
+          travel_dist,
+          receivers
           );
 
       // The overall ray's energy gets decreased by the total
@@ -986,6 +1816,428 @@ void Room<D>::simul_ray(
 }
 
 
+template<size_t D>
+template<int B>
+void Room<D>::log_specular_hits(
+    const Vectorf<D> &start,
+    const Vectorf<D> &dir,
+    float hit_distance,
+    float travel_dist,
+    const Arrayf<B> &transmitted,
+    Arrayf<B> &energy,
+    std::vector<Microphone<D>> &receivers
+    )
+{
+  /*
+   * Logs the energy of a specular ray segment in the histograms of the
+   * microphones it goes through.
+   *
+   * start: the origin of the segment
+   * dir: the unit direction of the segment
+   * hit_distance: the length of the segment
+   * travel_dist: the distance travelled by the ray before start
+   * transmitted: the energy carried by the ray
+   * energy: a buffer for the energy logged in the histograms
+   * receivers: the microphones where the hits are logged
+   *
+   * Only the receivers in the leaves of receiver_bvh crossed by the segment
+   * are tested.
+   */
+  const std::vector<int> &receiver_ids = receiver_bvh.order();
+
+  receiver_bvh.intersect(start, start + dir * hit_distance, hit_distance,
+      [&](int first, int count)
+      {
+        for (int i = first ; i < first + count ; i++)
+        {
+          int k = receiver_ids[i];
+
+          // Compute the distance between the line defined by (start, hit_point)
+          // and the center of the microphone (mic_pos)
+          Vectorf<D> to_mic = receivers[k].get_loc() - start;
+          float impact_distance = to_mic.dot(dir);
+
+          bool impacts = -libroom_eps < impact_distance && impact_distance < hit_distance + libroom_eps;
+
+          // If yes, we compute the ray's transmitted amplitude at the mic
+          // and we continue the ray
+          if (impacts &&
+              (to_mic - dir * impact_distance).norm() < mic_radius + libroom_eps)
+          {
+            // The length of this last hop
+            float distance = fabsf(impact_distance);
+
+            // Updating travel_time and transmitted amplitude for this ray
+            // We DON'T want to modify the variables transmitted amplitude and travel_dist
+            //   because the ray will continue its way          
+            float travel_dist_at_mic = travel_dist + distance;
+
+            double r_sq = double(travel_dist_at_mic) * travel_dist_at_mic;
+            auto p_hit = (1 - sqrt(1 - mic_radius_sq / std::max(mic_radius_sq, r_sq)));
+            energy = transmitted / (r_sq * p_hit);
+            // energy = transmitted / (travel_dist_at_mic - sqrtf(fmaxf(0.f, travel_dist_at_mic * travel_dist_at_mic - mic_radius_sq)));
+            receivers[k].log_histogram(travel_dist_at_mic, energy, start);
+          }
+        }
+
+        return false;
+      }
+      );
+}
+
+
+template<size_t D>
+template<int B, int P>
+void Room<D>::simul_ray_packet(
+    const float *phis,
+    const float *thetas,
+    int n_valid,
+    const Vectorf<D> &source_pos,
+    float energy_0,
+    std::vector<Microphone<D>> &receivers
+    )
+{
+  /*
+   * Same as simul_ray_impl, but traces P rays at once in a shoebox room.
+   *
+   * The coordinates of the rays are stored by dimension (one lane per ray)
+   * so that the slab test, the choice of the wall, and the specular
+   * reflection are loops without branches over the lanes that the
+   * compiler vectorizes. The hits at the microphones and the scattering
+   * are then handled ray by ray.
+   *
+   * phis, thetas: the angles of the rays
+   * n_valid: the number of rays in the packet, the remaining lanes are unused
+   */
+  float start[D][P], dir[D][P], hit[D][P], normal[D][P];
+  float plane_t[P], hit_t[P], hit_distance[P], travel_dist[P];
+  int on_wall[P], wall_index[P];
+  bool active[P];
+
+  // local copies, they cannot alias the arrays
+  const float eps = libroom_eps;
+  const float max_dist_ = max_dist;
+  float size[D];
+  for (size_t d = 0 ; d < D ; d++)
+    size[d] = shoebox_size[d];
+
+  for (int i = 0 ; i < P ; i++)
+  {
+    int r = std::min(i, n_valid - 1);  // unused lanes follow a valid ray
+
+    for (size_t d = 0 ; d < D ; d++)
+      start[d][i] = source_pos[d];
+
+    if (D == 2)
+    {
+      dir[0][i] = cos(phis[r]);
+      dir[1][i] = sin(phis[r]);
+    }
+    else
+    {
+      dir[0][i] = sin(thetas[r]) * cos(phis[r]);
+      dir[1][i] = sin(thetas[r]) * sin(phis[r]);
+      dir[D - 1][i] = cos(thetas[r]);
+    }
+
+    travel_dist[i] = 0.f;
+    active[i] = i < n_valid;
+  }
+
+  // The rays' characteristics
+  Arrayf<B> transmitted[P];
+  for (int i = 0 ; i < P ; i++)
+    transmitted[i] = Arrayf<B>::Ones(n_bands) * energy_0;
+  Arrayf<B> energy = Arrayf<B>::Ones(n_bands);
+
+  // All the rays of the packet bounce at the same time
+  int specular_counter(0);
+
+  // Convert the energy threshold to transmission threshold
+  float e_thres = energy_0 * energy_thres;
+  float distance_thres = time_thres * sound_speed;
+
+  Vectorf<D> start_i, dir_i, hit_i;
+  int n_active = n_valid;
+
+  while (n_active > 0)
+  {
+    for (int i = 0 ; i < P ; i++)
+    {
+      hit_t[i] = std::numeric_limits<float>::infinity();
+      wall_index[i] = -1;
+    }
+
+    // Slab test, the planes are tested in the order of the axes and the first
+    // one hit within the walls is kept, as in next_wall_hit
+    for (size_t d = 0 ; d < D ; d++)
+    {
+      for (int i = 0 ; i < P ; i++)
+      {
+        float abs_dir = std::abs(dir[d][i]);
+        float distance = dir[d][i] >= 0.f ? size[d] - start[d][i] : start[d][i];
+        plane_t[i] = distance / abs_dir;
+        on_wall[i] = (abs_dir * max_dist_ >= eps) & (distance >= eps) & (wall_index[i] < 0);
+      }
+
+      // the intersection with the plane should be on the wall
+      for (size_t e = 0 ; e < D ; e++)
+      {
+        if (e == d)
+          continue;
+
+        for (int i = 0 ; i < P ; i++)
+        {
+          float coord = start[e][i] + plane_t[i] * dir[e][i];
+          on_wall[i] &= (coord > -eps) & (coord < size[e] + eps);
+        }
+      }
+
+      for (int i = 0 ; i < P ; i++)
+      {
+        hit_t[i] = on_wall[i] ? plane_t[i] : hit_t[i];
+        wall_index[i] = on_wall[i] ? int(2 * d) + int(dir[d][i] >= 0.f) : wall_index[i];
+      }
+    }
+
+    // The hit coordinate on the axis of the wall is set exactly on the plane
+    for (int i = 0 ; i < P ; i++)
+      hit_distance[i] = 0.f;
+
+    for (size_t d = 0 ; d < D ; d++)
+    {
+      for (int i = 0 ; i < P ; i++)
+      {
+        float plane = dir[d][i] >= 0.f ? size[d] : 0.f;
+        hit[d][i] = wall_index[i] / 2 == int(d) ? plane : start[d][i] + hit_t[i] * dir[d][i];
+        float delta = hit[d][i] - start[d][i];
+        hit_distance[i] += delta * delta;
+      }
+    }
+
+    for (int i = 0 ; i < P ; i++)
+    {
+      hit_distance[i] = std::sqrt(hit_distance[i]);
+
+      // If no wall is hit (rounding errors), stop the ray
+      if (active[i] && wall_index[i] < 0)
+      {
+        active[i] = false;
+        n_active--;
+      }
+
+      if (!active[i])
+      {
+        for (size_t d = 0 ; d < D ; d++)
+          normal[d][i] = 0.f;
+        continue;
+      }
+
+      // Intersected wall
+      Wall<D> &wall = walls[wall_index[i]];
+
+      for (size_t d = 0 ; d < D ; d++)
+      {
+        normal[d][i] = wall.normal[d];
+        start_i[d] = start[d][i];
+        dir_i[d] = dir[d][i];
+        hit_i[d] = hit[d][i];
+      }
+
+      // Check if the specular ray hits any of the microphone
+      if (!(is_hybrid_sim && specular_counter < ism_order))
+        log_specular_hits(start_i, dir_i, hit_distance[i], travel_dist[i], transmitted[i], energy, receivers);
+
+      // Update the characteristics
+      travel_dist[i] += hit_distance[i];
+      transmitted[i] *= wall.get_energy_reflection();
+
+      // Let's shoot the scattered ray induced by the rebound on the wall
+      if (wall.scatter.maxCoeff() > 0.f)
+      {
+        scat_ray_impl(transmitted[i], wall, wall_index[i], start_i, hit_i, travel_dist[i], receivers);
+        transmitted[i] *= (1.f - wall.scatter);
+      }
+
+      // Check if we reach the thresholds for this ray
+      if (travel_dist[i] > distance_thres || transmitted[i].maxCoeff() < e_thres)
+      {
+        active[i] = false;
+        n_active--;
+      }
+    }
+
+    // set up for next iteration, the specular reflection conserves the length
+    specular_counter += 1;
+
+    float proj[P];
+    for (int i = 0 ; i < P ; i++)
+      proj[i] = 0.f;
+    for (size_t d = 0 ; d < D ; d++)
+      for (int i = 0 ; i < P ; i++)
+        proj[i] += dir[d][i] * normal[d][i];
+
+    for (size_t d = 0 ; d < D ; d++)
+    {
+      for (int i = 0 ; i < P ; i++)
+      {
+        dir[d][i] -= 2.f * normal[d][i] * proj[i];
+        start[d][i] = hit[d][i];
+      }
+    }
+  }
+}
+
+
+template<size_t D>
+template<int B, int P, class Func>
+void Room<D>::simul_ray_packets(
+    size_t begin,
+    size_t end,
+    const Func &ray_angles,
+    const Vectorf<D> &source_pos,
+    float energy_0,
+    std::vector<Microphone<D>> &receivers
+    )
+{
+  float phis[P], thetas[P];
+
+  for (size_t i = begin ; i < end ; i += P)
+  {
+    int n_valid = int(std::min<size_t>(P, end - i));
+    for (int j = 0 ; j < n_valid ; j++)
+      std::tie(phis[j], thetas[j]) = ray_angles(i + j);
+
+    simul_ray_packet<B, P>(phis, thetas, n_valid, source_pos, energy_0, receivers);
+  }
+}
+
+
+template<size_t D>
+template<class Func>
+void Room<D>::simul_rays(
+    size_t begin,
+    size_t end,
+    const Func &ray_angles,
+    const Vectorf<D> &source_pos,
+    float energy_0,
+    std::vector<Microphone<D>> &receivers
+    )
+{
+  /*
+   * For the common numbers of frequency bands, the energies of the rays
+   * are fixed size arrays so that tracing a ray does not allocate memory.
+   */
+  switch (n_bands)
+  {
+    case 1:
+      simul_rays_bands<1>(begin, end, ray_angles, source_pos, energy_0, receivers);
+      break;
+    case 7:
+      simul_rays_bands<7>(begin, end, ray_angles, source_pos, energy_0, receivers);
+      break;
+    case 8:
+      simul_rays_bands<8>(begin, end, ray_angles, source_pos, energy_0, receivers);
+      break;
+    case 16:
+      simul_rays_bands<16>(begin, end, ray_angles, source_pos, energy_0, receivers);
+      break;
+    default:
+      simul_rays_bands<Eigen::Dynamic>(begin, end, ray_angles, source_pos, energy_0, receivers);
+  }
+}
+
+
+template<size_t D>
+template<int B, class Func>
+void Room<D>::simul_rays_bands(
+    size_t begin,
+    size_t end,
+    const Func &ray_angles,
+    const Vectorf<D> &source_pos,
+    float energy_0,
+    std::vector<Microphone<D>> &receivers
+    )
+{
+  if (is_shoebox && ray_packet_size > 1)
+  {
+    switch (ray_packet_size)
+    {
+      case 4:
+        simul_ray_packets<B, 4>(begin, end, ray_angles, source_pos, energy_0, receivers);
+        return;
+      case 8:
+        simul_ray_packets<B, 8>(begin, end, ray_angles, source_pos, energy_0, receivers);
+        return;
+      case 16:
+        simul_ray_packets<B, 16>(begin, end, ray_angles, source_pos, energy_0, receivers);
+        return;
+    }
+  }
+
+  for (size_t i = begin ; i < end ; i++)
+  {
+    float phi, theta;
+    std::tie(phi, theta) = ray_angles(i);
+    simul_ray_impl<B>(phi, theta, source_pos, energy_0, receivers);
+  }
+}
+
+
+template<size_t D>
+template<class Func>
+void Room<D>::trace_rays(
+    size_t n_rays,
+    const Func &ray_angles,
+    const Vectorf<D> &source_pos,
+    float energy_0,
+    std::vector<Microphone<D>> &receivers
+    )
+{
+  /*
+   * Traces n_rays rays from source_pos and logs the hits in the receivers.
+   *
+   * ray_angles: a function returning the (azimuth, colatitude) pair of the i-th ray
+   *
+   * The rays are split in contiguous chunks, one per thread. Each chunk
+   * logs the hits in its own copy of the receivers and the copies are
+   * added to the receivers in the order of the chunks so that the result
+   * only depends on the number of threads used.
+   */
+
+  size_t n_chunks = std::min<size_t>(get_num_threads(n_threads), n_rays);
+
+  // the copies of the receivers share the same positions
+  prepare_receivers(receivers);
+
+  if (n_chunks <= 1)
+  {
+    simul_rays(0, n_rays, ray_angles, source_pos, energy_0, receivers);
+    return;
+  }
+
+  // private receivers for every chunk of rays
+  std::vector<std::vector<Microphone<D>>> chunk_receivers(n_chunks, receivers);
+
+  parallel_for(n_chunks, n_chunks,
+      [&](size_t c)
+      {
+        std::vector<Microphone<D>> &rx = chunk_receivers[c];
+        for (auto &mic : rx)
+          mic.reset();
+
+        simul_rays(c * n_rays / n_chunks, (c + 1) * n_rays / n_chunks,
+            ray_angles, source_pos, energy_0, rx);
+      }
+      );
+
+  // reduce in a fixed order
+  for (size_t c = 0 ; c < n_chunks ; c++)
+    for (size_t k = 0 ; k < receivers.size() ; k++)
+      receivers[k].merge(chunk_receivers[c][k]);
+}
+
+
 template<size_t D>
 void Room<D>::ray_tracing(
   const Eigen::Matrix<float,D-1,Eigen::Dynamic> &angles,
@@ -995,7 +2247,7 @@ void Room<D>::ray_tracing(
   // float energy_0 = 2.f / (mic_radius * mic_radius * angles.cols());
   float energy_0 = 2.f / angles.cols();
 
-  for (int k(0) ; k < angles.cols() ; k++)
+  auto ray_angles = [&](size_t k)
   {
     float phi = angles.coeff(0,k);
     float theta = pi_2;
@@ -1003,8 +2255,10 @@ void Room<D>::ray_tracing(
     if (D == 3)
       theta = angles.coeff(1,k);
 
-    simul_ray(phi, theta, source_pos, energy_0);
-  }
+    return std::make_pair(phi, theta);
+  };
+
+  trace_rays(angles.cols(), ray_angles, source_pos, energy_0, microphones);
 }
 
 
@@ -1035,34 +2289,31 @@ void Room<D>::ray_tracing(
   // initial energy of one ray
   float energy_0 = 2.f / (nb_phis * nb_thetas);
 
+  // if we work in 2D rooms, only 1 elevation angle is needed
+  size_t n_thetas = (D == 2) ? 1 : nb_thetas;
+
   // ------------------ RAY TRACING --------------------
 
-  for (size_t i(0); i < nb_phis; ++i)
+  auto ray_angles = [&](size_t k)
   {
+    size_t i = k / n_thetas;
+    size_t j = k % n_thetas;
+
     float phi = 2 * pi * (float) i / nb_phis;
 
-    for (size_t j(0); j < nb_thetas; ++j)
-    {
-      // Having a 3D uniform sampling of the sphere surrounding the room
-      float theta = std::acos(2 * ((float) j / nb_thetas) - 1);
+    // Having a 3D uniform sampling of the sphere surrounding the room
+    float theta = std::acos(2 * ((float) j / nb_thetas) - 1);
 
-      // For 2D, this parameter means nothing, but we set it to
-      // PI/2 to be consistent
-      if (D == 2) {
-        theta = pi_2;
-      }
+    // For 2D, this parameter means nothing, but we set it to
+    // PI/2 to be consistent
+    if (D == 2) {
+      theta = pi_2;
+    }
 
-      // Trace this ray
-      simul_ray(phi, theta, source_pos, energy_0);
+    return std::make_pair(phi, theta);
+  };
 
-      // if we work in 2D rooms, only 1 elevation angle is needed
-      // => get out of the theta loop
-      if (D == 2)
-      {
-        break;
-      }
-    }
-  }
+  trace_rays(nb_phis * n_thetas, ray_angles, source_pos, energy_0, microphones);
 }
 
 
@@ -1080,7 +2331,119 @@ void Room<D>::ray_tracing(
    source_pos: (array size 2 or 3) represents the position of the sound source
    */
 
+  trace_rays(n_rays, source_pos, microphones);
+}
+
+
+template<size_t D>
+RowArrayXXf Room<D>::ray_tracing_sources(
+    size_t n_rays,
+    const Eigen::Matrix<float,D,Eigen::Dynamic> &source_locs
+    )
+{
+  /*
+   * Runs the ray tracing for all the sources, one after the other, and
+   * collects the histograms of the microphones in a single array.
+   *
+   * n_rays: the number of rays traced from every source
+   * source_locs: the locations of the sources, one per column
+   *
+   * :returns: an array with n_sources * n_mics * n_bands rows where the
+   *   energy histogram of source s at microphone m is in the rows
+   *   (s * n_mics + m) * n_bands, ..., (s * n_mics + m + 1) * n_bands - 1,
+   *   i.e., the array can be viewed as a (n_sources, n_mics, n_bands, n_bins)
+   *   tensor without copy. The microphones are reset at the end.
+   */
+  size_t n_sources = source_locs.cols();
+  size_t n_mics = microphones.size();
+
+  RowArrayXXf stack = RowArrayXXf::Zero(n_sources * n_mics * n_bands, 0);
+
+  for (size_t s = 0 ; s < n_sources ; s++)
+  {
+    reset_mics();
+    trace_rays(n_rays, source_locs.col(s), microphones);
+
+    for (size_t m = 0 ; m < n_mics ; m++)
+      stack_histogram(microphones[m], (s * n_mics + m) * n_bands, stack);
+  }
+
+  reset_mics();
+
+  return stack;
+}
+
+
+template<size_t D>
+RowArrayXXf Room<D>::ray_tracing_reciprocal(
+    size_t n_rays,
+    const Eigen::Matrix<float,D,Eigen::Dynamic> &source_locs
+    )
+{
+  /*
+   * Ray tracing that uses the reciprocity of the sound propagation. The
+   * rays are traced from every microphone and the hits are logged in
+   * receivers placed at the sources, so that the cost grows with the
+   * number of microphones rather than with the number of sources.
+   *
+   * The sources and the microphones are omnidirectional, and the receivers
+   * at the sources have the same radius as the microphones.
+   *
+   * n_rays: the number of rays traced from every microphone
+   * source_locs: the locations of the sources, one per column
+   *
+   * :returns: the histograms, in the same layout as ray_tracing_sources
+   */
+  size_t n_sources = source_locs.cols();
+  size_t n_mics = microphones.size();
+
+  RowArrayXXf stack = RowArrayXXf::Zero(n_sources * n_mics * n_bands, 0);
+
+  std::vector<Microphone<D>> receivers;
+  for (size_t s = 0 ; s < n_sources ; s++)
+    receivers.push_back(
+        Microphone<D>(source_locs.col(s), n_bands, mic_hist_res * sound_speed, time_thres * sound_speed)
+        );
+
+  for (size_t m = 0 ; m < n_mics ; m++)
+  {
+    for (auto &rx : receivers)
+      rx.reset();
+
+    trace_rays(n_rays, microphones[m].get_loc(), receivers);
 
+    for (size_t s = 0 ; s < n_sources ; s++)
+      stack_histogram(receivers[s], (s * n_mics + m) * n_bands, stack);
+  }
+
+  return stack;
+}
+
+
+template<size_t D>
+void Room<D>::stack_histogram(const Microphone<D> &receiver, size_t first, RowArrayXXf &stack)
+{
+  const Eigen::ArrayXXf &hist = receiver.histograms[0].get_array();
+
+  if (hist.cols() > stack.cols())
+  {
+    // the new columns of the histograms already stacked are zero
+    auto old_cols = stack.cols();
+    stack.conservativeResize(Eigen::NoChange, hist.cols());
+    stack.rightCols(hist.cols() - old_cols).setZero();
+  }
+
+  stack.block(first, 0, n_bands, hist.cols()) = hist;
+}
+
+
+template<size_t D>
+void Room<D>::trace_rays(
+    size_t n_rays,
+    const Vectorf<D> &source_pos,
+    std::vector<Microphone<D>> &receivers
+    )
+{
   // ------------------ INIT --------------------
   // initial energy of one ray
   float energy_0 = 2.f / n_rays;
@@ -1091,7 +2454,7 @@ void Room<D>::ray_tracing(
     auto offset = 2.f / n_rays;
     auto increment = pi * (3.f - sqrt(5.f));  // phi increment
 
-    for (size_t i(0); i < n_rays ; ++i)
+    auto ray_angles = [&](size_t i)
     {
       auto z = (i * offset - 1) + offset / 2.f;
       auto rho = sqrt(1.f - z * z);
@@ -1101,17 +2464,24 @@ void Room<D>::ray_tracing(
       auto x = cos(phi) * rho;
       auto y = sin(phi) * rho;
 
-      auto azimuth = atan2(y, x);
-      auto colatitude = atan2(sqrt(x * x + y * y), z);
+      float azimuth = atan2(y, x);
+      float colatitude = atan2(sqrt(x * x + y * y), z);
 
-      simul_ray(azimuth, colatitude, source_pos, energy_0);
-    }
+      return std::make_pair(azimuth, colatitude);
+    };
+
+    trace_rays(n_rays, ray_angles, source_pos, energy_0, receivers);
   }
   else if (D == 2)
   {
     float offset = 2. * pi / n_rays;
-    for (size_t i(0) ; i < n_rays ; ++i)
-      simul_ray(i * offset, 0.f, source_pos, energy_0);
+
+    auto ray_angles = [&](size_t i)
+    {
+      return std::make_pair(i * offset, 0.f);
+    };
+
+    trace_rays(n_rays, ray_angles, source_pos, energy_0, receivers);
   }
 }
 
@@ -1154,6 +2524,9 @@ bool Room<D>::contains(const Vectorf<D> point)
 
   Vectorf<D> outside_point = min_coord.col(0);
 
+  // a generator local to the call, so that rooms can be used on several threads
+  std::minstd_rand rng;
+
   // ------------------------------------------
 
   // Now we build a segment between 'outside_point' and 'point' 
@@ -1172,26 +2545,22 @@ bool Room<D>::contains(const Vectorf<D> point)
     n_intersections = 0;
     ambiguous_intersection = false;
 
-    outside_point[0] -= (float)(rand() % 27) / 50;
-    outside_point[1] -= (float)(rand() % 22) / 26;
+    outside_point[0] -= (float)(rng() % 27) / 50;
+    outside_point[1] -= (float)(rng() % 22) / 26;
 
     if (D == 3)
     {
-      outside_point[2] -= (float)(rand() % 24 / 47);
+      outside_point[2] -= (float)(rng() % 24 / 47);
     }
 
-    for (size_t i(0); i < n_walls; ++i)
-    {
-
-      Wall<D> & w = walls[i];
-      int result = w.intersects(outside_point, point);
-      ambiguous_intersection = ambiguous_intersection || (result > 0);
-
-      if (result > -1)
-      {
-        n_intersections++;
-      }
-    }
+    wall_cache.intersect(outside_point, point, 0, wall_cache.size(),
+        [&](int, int result, const Vectorf<D> &)
+        {
+          ambiguous_intersection = ambiguous_intersection || (result > 0);
+          n_intersections++;
+          return false;
+        }
+        );
   } while (ambiguous_intersection);
 
   // If an odd number of walls have been intersected,
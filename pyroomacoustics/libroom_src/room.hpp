@@ -27,51 +27,136 @@
 #define __ROOM_H__
 
 #include <vector>
-#include <stack>
 #include <tuple>
 #include <Eigen/Dense>
 #include <algorithm>
+#include <limits>
+#include <random>
 #include <ctime>
 
 #include "common.hpp"
 #include "wall.hpp"
+#include "bvh.hpp"
+#include "wall_cache.hpp"
+#include "visibility.hpp"
+#include "beam.hpp"
+#include "rir_builder.hpp"
+#include "parallel.hpp"
 
 template<size_t D>
-struct ImageSource
+struct ImageSourceSearch
 {
   /*
-   * A class to hold the information relating to an Image source when running the ISM
+   * The working memory of the depth first search of the image sources of
+   * a general room.
+   *
+   * The image sources on the path from the real source to the image source
+   * being visited are stored by order, i.e., the parent of the image source
+   * at index k is the one at index k - 1. The visible image sources are
+   * appended to contiguous buffers. Once the buffers have grown to their
+   * final size, the search does not allocate memory.
    */
 
-  Vectorf<D> loc;
-  Eigen::ArrayXf attenuation;
-  int order;
-  int gen_wall;
-  ImageSource *parent;
-  VectorXb visible_mics;
-
-  // this is a unit vector from the center of the source pointing
-  // in the direction of the path to the microphone
-  Vectorf<D> source_impact_dir;
-
-  // This contains the reflection orders with respect to x/y/z axis
-  // for the shoebox image source model
-  Vectori<D> order_xyz;
-
-  ImageSource(size_t n_bands)
-    : order(0), gen_wall(-1), parent(NULL)
+  // The path, index 0 is the real source
+  std::vector<Vectorf<D>> loc;
+  std::vector<int> gen_wall;  // -1 for the real source
+  std::vector<int> next_wall;  // the next wall to reflect the image source across
+  Eigen::ArrayXXf attenuation;  // n_bands x (max_order + 1)
+  std::vector<Beam<D>> beams;  // only used with ism_beam_pruning
+  std::vector<Vectorf<D>> clip_buffer;
+
+  // The rays from the microphones during the visibility checks
+  std::vector<Vectorf<D>> mic_points;
+  std::vector<int> mic_active;
+
+  // The visible image sources
+  std::vector<float> out_loc;  // D values per image source
+  std::vector<float> out_attenuation;  // n_bands values per image source
+  std::vector<int> out_order;
+  std::vector<int> out_gen_wall;
+  std::vector<char> out_visible_mics;  // n_mics values per image source
+
+  // All the image sources visited, visible or not, when the tree is kept
+  bool record_tree = false;
+  std::vector<float> tree_loc;  // D values per image source
+  std::vector<float> tree_attenuation;  // n_bands values per image source
+  std::vector<int> tree_order;
+  std::vector<int> tree_gen_wall;
+  float tree_radius;  // how far the source can move without changing the reflections tested
+
+  void init(const Vectorf<D> &source, size_t n_bands, int max_order)
   {
-    loc.setZero();
-    attenuation.resize(n_bands);
-    attenuation.setOnes();
+    loc.resize(max_order + 1);
+    gen_wall.resize(max_order + 1);
+    next_wall.resize(max_order + 1);
+    attenuation.resize(n_bands, max_order + 1);
+    beams.resize(max_order + 1);
+
+    loc[0] = source;
+    gen_wall[0] = -1;
+    attenuation.col(0).setOnes();
+    beams[0].clear();
+
+    out_loc.clear();
+    out_attenuation.clear();
+    out_order.clear();
+    out_gen_wall.clear();
+    out_visible_mics.clear();
+
+    record_tree = false;
+    tree_radius = std::numeric_limits<float>::infinity();
+    tree_loc.clear();
+    tree_attenuation.clear();
+    tree_order.clear();
+    tree_gen_wall.clear();
   }
 
-  ImageSource(const Vectorf<D> &_loc, size_t n_bands)
-    : loc(_loc), order(0), gen_wall(-1), parent(NULL)
-  {
-    attenuation.resize(n_bands);
-    attenuation.setOnes();
-  }
+  size_t size() const { return out_order.size(); }
+};
+
+template<size_t D>
+struct ImageSourceTree
+{
+  /*
+   * The image sources found by the image source model before the
+   * visibility checks. They do not depend on the microphones, so that the
+   * visibility from a new set of microphones can be computed without
+   * searching the image sources again.
+   *
+   * The image sources are stored in the order of the depth first search,
+   * the real source first. The tree of a shoebox room only keeps the
+   * location of the source.
+   *
+   * Every image source is the source mapped by the composition of the
+   * reflections across its generating walls, an affine map that is kept
+   * so that the image sources of a moved source are found with a single
+   * matrix product. The reflections are isometries, so that the distance
+   * of the image sources to the walls changes by at most the distance
+   * moved and the tree found by the search stays the same as long as the
+   * source is within move_radius of the source of the search.
+   */
+  Vectorf<D> source;
+  bool is_shoebox = false;
+  Eigen::Matrix<float,D,Eigen::Dynamic> locs;
+  Eigen::MatrixXf attenuations;  // n_bands x n_nodes
+  Eigen::VectorXi orders;
+  Eigen::VectorXi gen_walls;
+  Eigen::VectorXi parents;  // -1 for the real source
+
+  // The image source i is linear.middleRows(D * i, D) * source + offsets.col(i)
+  Eigen::Matrix<float,Eigen::Dynamic,D> linear;  // (D * n_nodes) x D
+  Eigen::Matrix<float,D,Eigen::Dynamic> offsets;
+  Vectorf<D> anchor;  // the source of the search
+  float move_radius = 0.f;  // 0 if the tree depends on the beams or the microphones
+
+  size_t size() const { return orders.size(); }
+};
+
+// A row of images of a shoebox room along the x axis, from x_min to x_max,
+// first is the index of its first image in the output arrays
+struct ShoeboxRow
+{
+  int z, y, x_min, x_max, first;
 };
 
 /*
@@ -91,6 +176,10 @@ class Room
 
     // Simulation parameters
     int ism_order = 0.;
+    int ism_n_threads = 1;  // threads used by the image source model of general rooms, 0 means all the cores
+    float ism_max_distance = 0.f;  // image sources farther from the microphones are not searched, 0 disables it
+    bool ism_beam_pruning = false;  // skip the walls outside the beams of the image sources of general rooms
+    bool ism_keep_tree = false;  // keep the image sources of the last run in ism_tree
 
     // Ray tracing parameters
     float energy_thres = 1e-7;
@@ -99,6 +188,9 @@ class Room
     double mic_radius_sq = 0.15f * 0.15f;  // receiver radius in meters
     float mic_hist_res = 0.004;  // in seconds
     bool is_hybrid_sim = true;
+    int n_threads = 1;  // threads used for ray tracing, 0 means all the cores
+    int ray_packet_size = 1;  // rays traced together in shoebox rooms, 1 disables the packets
+    float visibility_patch_size = 0.f;  // size of the patches of the visibility table, 0 disables it
 
     // Special parameters for shoebox rooms
     bool is_shoebox = false;
@@ -122,6 +214,9 @@ class Room
     // its size is n_microphones * n_sources
     MatrixXb visible_mics;
 
+    // The image sources of the last run, visible or not, with ism_keep_tree
+    ImageSourceTree<D> ism_tree;
+
     // Constructor for general rooms
     Room(
         const std::vector<Wall<D>> &_walls,
@@ -155,12 +250,38 @@ class Room
         bool _is_hybrid_sim
         );
 
+    // Constructor for rooms given by a mesh
+    Room(
+        const Eigen::Matrix<float,D,Eigen::Dynamic> &_vertices,
+        const RowArrayXXi &_faces,
+        const Eigen::ArrayXXf &_absorption,
+        const Eigen::ArrayXXf &_scattering,
+        const std::vector<int> &_obstructing_walls,
+        const std::vector<Microphone<D>> &_microphones,
+        float _sound_speed,
+        // parameters for the image source model
+        int _ism_order,
+        // parameters for the ray tracing
+        float _energy_thres,
+        float _time_thres,
+        float _mic_radius,
+        float _mic_hist_res,
+        bool _is_hybrid_sim
+        );
+
     void make_shoebox_walls(
         const Vectorf<D> &rs,  // room_size
         const Eigen::Array<float,Eigen::Dynamic,2*D> &abs,
         const Eigen::Array<float,Eigen::Dynamic,2*D> &scat
         );
 
+    void make_mesh_walls(
+        const Eigen::Matrix<float,D,Eigen::Dynamic> &vertices,
+        const RowArrayXXi &faces,
+        const Eigen::ArrayXXf &abs,
+        const Eigen::ArrayXXf &scat
+        );
+
     void init();
 
     void set_params(
@@ -186,6 +307,32 @@ class Room
     void set_is_hybrid_sim(bool state) { is_hybrid_sim = state; }
     bool get_is_hybrid_sim() { return is_hybrid_sim; }
 
+    void set_n_threads(int _n_threads) { n_threads = _n_threads; }
+    int get_n_threads() { return n_threads; }
+
+    void set_ray_packet_size(int size)
+    {
+      if (size != 1 && size != 4 && size != 8 && size != 16)
+        throw std::runtime_error("Error: The ray packet size should be 1, 4, 8, or 16");
+      ray_packet_size = size;
+    }
+    int get_ray_packet_size() { return ray_packet_size; }
+
+    void set_visibility_patch_size(float size) { visibility_patch_size = size; }
+    float get_visibility_patch_size() { return visibility_patch_size; }
+
+    void set_ism_n_threads(int _n_threads) { ism_n_threads = _n_threads; }
+    int get_ism_n_threads() { return ism_n_threads; }
+
+    void set_ism_max_distance(float distance) { ism_max_distance = distance; }
+    float get_ism_max_distance() { return ism_max_distance; }
+
+    void set_ism_beam_pruning(bool state) { ism_beam_pruning = state; }
+    bool get_ism_beam_pruning() { return ism_beam_pruning; }
+
+    void set_ism_keep_tree(bool state) { ism_keep_tree = state; }
+    bool get_ism_keep_tree() { return ism_keep_tree; }
+
     void add_mic(const Vectorf<D> &loc)
     {
       microphones.push_back(
@@ -193,6 +340,14 @@ class Room
           );
     }
 
+    // Replaces the microphones by the ones at the columns of locs
+    void set_mics(const Eigen::Matrix<float,D,Eigen::Dynamic> &locs)
+    {
+      microphones.clear();
+      for (int m = 0 ; m < locs.cols() ; m++)
+        add_mic(locs.col(m));
+    }
+
     void reset_mics()
     {
       for (auto mic = microphones.begin() ; mic != microphones.end() ; ++mic)
@@ -204,6 +359,25 @@ class Room
     // Image source model methods
     int image_source_model(const Vectorf<D> &source_location);
 
+    // Recomputes the visible image sources of a tree kept by a previous run
+    // for the current microphones, the result is as with image_source_model
+    int image_source_visibility(const ImageSourceTree<D> &tree);
+
+    // Moves the image sources of a tree to the ones of a new source location,
+    // returns false if the tree could be different for the new location
+    bool move_image_source_tree(ImageSourceTree<D> &tree, const Vectorf<D> &source) const;
+
+    // The impulse responses of a shoebox room due to the image sources, one
+    // n_bands x n_samples array per microphone, without storing the images
+    std::vector<RowArrayXXd> shoebox_rir(
+        const Vectorf<D> &source,
+        double fs,
+        double c,
+        int fdl,
+        int lut_gran = 20,
+        int length = 0
+        );
+
     float get_max_distance();
 
     std::tuple < Vectorf<D>, int, float > next_wall_hit(
@@ -243,20 +417,168 @@ class Room
         const Vectorf<D> source_pos
         );
 
+    // Ray tracing of several sources, the histograms of all the pairs of
+    // sources and microphones are returned in one array, the rows
+    // (source * n_mics + mic) * n_bands + band contain the histograms
+    RowArrayXXf ray_tracing_sources(
+        size_t n_rays,
+        const Eigen::Matrix<float,D,Eigen::Dynamic> &source_locs
+        );
+
+    // Reciprocal ray tracing, the rays are traced from the microphones and
+    // logged at the sources, the result is as in ray_tracing_sources
+    RowArrayXXf ray_tracing_reciprocal(
+        size_t n_rays,
+        const Eigen::Matrix<float,D,Eigen::Dynamic> &source_locs
+        );
+
     bool contains(const Vectorf<D> point);
 
   private:
-    // We need a stack to store the image sources during the algorithm
-    std::stack<ImageSource<D>> visible_sources;
+    // The working memory of the image source model, one per task
+    std::vector<ImageSourceSearch<D>> ism_searches;
+
+    // Acceleration structure for the wall intersections of polygonal rooms
+    WallBVH<D> wall_bvh;
+    std::vector<int> obstructing_index;  // position of a wall in obstructing_walls, or -1
+
+    // Acceleration structures over the receivers
+    // They are built at the beginning of the ray tracing
+    BVH<D> receiver_bvh;  // for the specular hits
+    PatchVisibility<D> patch_visibility;  // for the scattered rays in polygonal rooms
+    void prepare_receivers(const std::vector<Microphone<D>> &receivers);
+
+    // Packed copies of the walls for the vectorized intersection tests
+    WallCache<D> wall_cache;  // all the walls, in the order of wall_bvh if any
+    WallCache<D> obstructing_cache;  // the obstructing walls only
+
+    // The convex hulls of the walls, the initial apertures of the beams
+    std::vector<std::vector<Vectorf<D>>> wall_hulls;
+
+    // true if a wall in obstructing_walls stands between start and end
+    bool is_obstructed(const Vectorf<D> &start, const Vectorf<D> &end);
 
     // A specialized method for the shoebox room case
     int image_source_shoebox(const Vectorf<D> &source);
+    std::vector<Eigen::ArrayXXf> shoebox_transmission() const;
+    int shoebox_rows(const Vectorf<D> &source, std::vector<ShoeboxRow> &rows) const;
+    int shoebox_image(
+        const Vectorf<D> &source,
+        const int *point,
+        const std::vector<Eigen::ArrayXXf> &transmission_pwr,
+        Eigen::Ref<Vectorf<D>> loc,
+        Eigen::Ref<Eigen::VectorXf> attenuation
+        ) const;
 
     // Image source model internal methods
-    void image_sources_dfs(ImageSource<D> &is, int max_order);
-    bool is_visible_dfs(const Vectorf<D> &p, ImageSource<D> &is);
-    bool is_obstructed_dfs(const Vectorf<D> &p, ImageSource<D> &is);
-    int fill_sources();
+    // The image sources are referred to by their index k in the path of search
+    template<class Func>
+    void walk_image_sources(ImageSourceSearch<D> &search, int root, int max_order, const Func &visit);
+    void image_sources_dfs(ImageSourceSearch<D> &search, int root, int max_order);
+    void image_sources_parallel(const Vectorf<D> &source_location, int n_threads);
+    bool reflect_image_source(ImageSourceSearch<D> &search, int k, int wall_id);
+    void visit_image_source(ImageSourceSearch<D> &search, int k);
+    bool is_in_ism_range(const Vectorf<D> &loc, int mic_id = -1) const;
+    void visible_mics_dfs(ImageSourceSearch<D> &search, int k, char *visible);
+    bool is_obstructed_dfs(const Vectorf<D> &p, const ImageSourceSearch<D> &search, int k);
+    int fill_sources(const std::vector<ImageSourceSearch<D>> &searches);
+    void fill_tree(const Vectorf<D> &source, const std::vector<ImageSourceSearch<D>> &searches);
+
+    // Ray tracing internal methods, the hits are logged in the receivers provided
+    template<class Func>
+    void trace_rays(
+        size_t n_rays,
+        const Func &ray_angles,
+        const Vectorf<D> &source_pos,
+        float energy_0,
+        std::vector<Microphone<D>> &receivers
+        );
+
+    // Copies the histogram of a receiver to rows first, ..., first + n_bands - 1
+    // of a stack of histograms, the stack is widened if needed
+    void stack_histogram(const Microphone<D> &receiver, size_t first, RowArrayXXf &stack);
+
+    // Same as trace_rays with the rays sampled with the Fibonacci algorithm
+    void trace_rays(
+        size_t n_rays,
+        const Vectorf<D> &source_pos,
+        std::vector<Microphone<D>> &receivers
+        );
+
+    template<int B>
+    bool scat_ray_impl(
+        const Arrayf<B> &transmitted,
+        const Wall<D> &wall,
+        int wall_id,
+        const Vectorf<D> &prev_last_hit,
+        const Vectorf<D> &hit_point,
+        float travel_dist,
+        std::vector<Microphone<D>> &receivers
+        );
+
+    template<int B>
+    void simul_ray_impl(
+        float phi,
+        float theta,
+        const Vectorf<D> &source_pos,
+        float energy_0,
+        std::vector<Microphone<D>> &receivers
+        );
+
+    // Logs the specular hits of the segment (start, start + hit_distance * dir)
+    template<int B>
+    void log_specular_hits(
+        const Vectorf<D> &start,
+        const Vectorf<D> &dir,
+        float hit_distance,
+        float travel_dist,
+        const Arrayf<B> &transmitted,
+        Arrayf<B> &energy,
+        std::vector<Microphone<D>> &receivers
+        );
+
+    // Traces P rays together in a shoebox room, the first n_valid are used
+    template<int B, int P>
+    void simul_ray_packet(
+        const float *phis,
+        const float *thetas,
+        int n_valid,
+        const Vectorf<D> &source_pos,
+        float energy_0,
+        std::vector<Microphone<D>> &receivers
+        );
+
+    // Traces the rays begin to end-1, in packets if enabled
+    template<class Func>
+    void simul_rays(
+        size_t begin,
+        size_t end,
+        const Func &ray_angles,
+        const Vectorf<D> &source_pos,
+        float energy_0,
+        std::vector<Microphone<D>> &receivers
+        );
+
+    // Same as simul_rays with the energies stored in arrays of size B
+    template<int B, class Func>
+    void simul_rays_bands(
+        size_t begin,
+        size_t end,
+        const Func &ray_angles,
+        const Vectorf<D> &source_pos,
+        float energy_0,
+        std::vector<Microphone<D>> &receivers
+        );
+
+    template<int B, int P, class Func>
+    void simul_ray_packets(
+        size_t begin,
+        size_t end,
+        const Func &ray_angles,
+        const Vectorf<D> &source_pos,
+        float energy_0,
+        std::vector<Microphone<D>> &receivers
+        );
 
 };
 
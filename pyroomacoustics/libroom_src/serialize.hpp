@@ -0,0 +1,510 @@
+/*
+ * Binary serialization of the rooms, walls and microphones
+ * Copyright (C) 2019  Robin Scheibler, Cyril Cadoux
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * You should have received a copy of the MIT License along with this program. If
+ * not, see <https://opensource.org/licenses/MIT>.
+ */
+#ifndef __SERIALIZE_HPP__
+#define __SERIALIZE_HPP__
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <Eigen/Dense>
+
+#include "common.hpp"
+#include "wall.hpp"
+#include "microphone.hpp"
+#include "room.hpp"
+
+/*
+ * The objects are written as their raw values in the native byte order,
+ * after a short header with a magic string, a marker of the byte order, the
+ * version of the format, the kind of object and the dimension. The data
+ * written on a machine with the other byte order is rejected. The arrays are written as their number of
+ * rows and columns followed by their coefficients in column major order.
+ * Every object is rebuilt with its constructor, so that the values derived
+ * from the stored ones are computed again.
+ */
+
+#define SERIALIZE_MAGIC "PRAL"
+#define SERIALIZE_VERSION 1
+#define SERIALIZE_BYTE_ORDER uint16_t(0x0102)
+
+enum class SerialKind : uint8_t { WALL = 1, MICROPHONE = 2, HISTOGRAM = 3, ROOM = 4 };
+
+class ByteWriter
+{
+  std::string buffer;
+
+  public:
+    template<class T>
+    void write(const T &value)
+    {
+      buffer.append(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    void write_string(const std::string &value)
+    {
+      write<uint64_t>(value.size());
+      buffer.append(value);
+    }
+
+    template<class Derived>
+    void write_dense(const Eigen::DenseBase<Derived> &value)
+    {
+      typename Derived::PlainObject plain = value;
+      write<int64_t>(plain.rows());
+      write<int64_t>(plain.cols());
+      /* the row major objects are transposed to have a single layout */
+      for (Eigen::Index c = 0 ; c < plain.cols() ; c++)
+        for (Eigen::Index r = 0 ; r < plain.rows() ; r++)
+          write(plain.coeff(r, c));
+    }
+
+    template<class T>
+    void write_vector(const std::vector<T> &value)
+    {
+      write<uint64_t>(value.size());
+      for (auto &v : value)
+        write(v);
+    }
+
+    void write_header(SerialKind kind, size_t dim)
+    {
+      buffer.append(SERIALIZE_MAGIC, 4);
+      write<uint16_t>(SERIALIZE_BYTE_ORDER);
+      write<uint8_t>(SERIALIZE_VERSION);
+      write<uint8_t>(uint8_t(kind));
+      write<uint8_t>(uint8_t(dim));
+    }
+
+    const std::string &bytes() const { return buffer; }
+};
+
+class ByteReader
+{
+  const std::string &buffer;
+  size_t pos = 0;
+
+  void take(void *dst, size_t n)
+  {
+    if (n > buffer.size() - pos)
+      throw std::runtime_error("Error: The serialized data is truncated");
+    std::memcpy(dst, buffer.data() + pos, n);
+    pos += n;
+  }
+
+  public:
+    ByteReader(const std::string &_buffer) : buffer(_buffer) {}
+
+    template<class T>
+    T read()
+    {
+      T value;
+      take(&value, sizeof(T));
+      return value;
+    }
+
+    std::string read_string()
+    {
+      uint64_t n = read<uint64_t>();
+      if (n > buffer.size() - pos)
+        throw std::runtime_error("Error: The serialized data is truncated");
+      std::string value = buffer.substr(pos, n);
+      pos += n;
+      return value;
+    }
+
+    template<class Matrix>
+    void read_dense(Matrix &value)
+    {
+      int64_t rows = read<int64_t>();
+      int64_t cols = read<int64_t>();
+
+      if (rows < 0 || cols < 0
+          || (Matrix::RowsAtCompileTime != Eigen::Dynamic && rows != Matrix::RowsAtCompileTime)
+          || (Matrix::ColsAtCompileTime != Eigen::Dynamic && cols != Matrix::ColsAtCompileTime))
+        throw std::runtime_error("Error: The serialized array does not have the expected size");
+      if (uint64_t(rows) * uint64_t(cols) > (buffer.size() - pos) / sizeof(typename Matrix::Scalar))
+        throw std::runtime_error("Error: The serialized data is truncated");
+
+      value.resize(rows, cols);
+      for (Eigen::Index c = 0 ; c < cols ; c++)
+        for (Eigen::Index r = 0 ; r < rows ; r++)
+          value.coeffRef(r, c) = read<typename Matrix::Scalar>();
+    }
+
+    template<class T>
+    std::vector<T> read_vector()
+    {
+      uint64_t n = read<uint64_t>();
+      if (n > (buffer.size() - pos) / sizeof(T))
+        throw std::runtime_error("Error: The serialized data is truncated");
+      std::vector<T> value(n);
+      for (auto &v : value)
+        v = read<T>();
+      return value;
+    }
+
+    void read_header(SerialKind kind, size_t dim)
+    {
+      char magic[4];
+      take(magic, 4);
+      if (std::memcmp(magic, SERIALIZE_MAGIC, 4) != 0)
+        throw std::runtime_error("Error: The data is not a serialized libroom object");
+      if (read<uint16_t>() != SERIALIZE_BYTE_ORDER)
+        throw std::runtime_error("Error: The serialized data was written with another byte order");
+      if (read<uint8_t>() != SERIALIZE_VERSION)
+        throw std::runtime_error("Error: The serialized data has an unsupported version");
+      if (read<uint8_t>() != uint8_t(kind))
+        throw std::runtime_error("Error: The serialized data is another kind of object");
+      if (read<uint8_t>() != uint8_t(dim))
+        throw std::runtime_error("Error: The serialized data has another dimension");
+    }
+
+    void check_end() const
+    {
+      if (pos != buffer.size())
+        throw std::runtime_error("Error: The serialized data has trailing bytes");
+    }
+};
+
+template<size_t D>
+void write_wall(ByteWriter &out, const Wall<D> &wall)
+{
+  out.write_dense(wall.corners);
+  out.write_dense(wall.absorption);
+  out.write_dense(wall.scatter);
+  out.write_string(wall.name);
+}
+
+template<size_t D>
+Wall<D> read_wall(ByteReader &in)
+{
+  Eigen::Matrix<float,D,Eigen::Dynamic> corners;
+  Eigen::ArrayXf absorption, scatter;
+  in.read_dense(corners);
+  in.read_dense(absorption);
+  in.read_dense(scatter);
+  std::string name = in.read_string();
+  return Wall<D>(corners, absorption, scatter, name);
+}
+
+inline void write_histogram(ByteWriter &out, const Histogram2D &hist)
+{
+  out.write_dense(hist.get_array());
+  out.write_dense(hist.get_counts());
+}
+
+inline Histogram2D read_histogram(ByteReader &in)
+{
+  Eigen::ArrayXXf array;
+  Eigen::ArrayXXi counts;
+  in.read_dense(array);
+  in.read_dense(counts);
+  return Histogram2D(array, counts);
+}
+
+template<size_t D>
+void write_microphone(ByteWriter &out, const Microphone<D> &mic)
+{
+  /* the hits are not stored, the engine only logs the histograms */
+  out.write_dense(mic.loc);
+  out.write<int32_t>(mic.n_bands);
+  out.write<float>(mic.hist_resolution);
+  out.write<uint64_t>(mic.histograms.size());
+  for (auto &hist : mic.histograms)
+    write_histogram(out, hist);
+}
+
+template<size_t D>
+Microphone<D> read_microphone(ByteReader &in)
+{
+  Vectorf<D> loc;
+  in.read_dense(loc);
+  int n_bands = in.read<int32_t>();
+  float hist_resolution = in.read<float>();
+
+  if (n_bands < 1 || !(hist_resolution > 0.f))
+    throw std::runtime_error("Error: The serialized microphone is not valid");
+
+  Microphone<D> mic(loc, n_bands, hist_resolution, 0.f);
+
+  uint64_t n_hist = in.read<uint64_t>();
+  if (n_hist != mic.histograms.size())
+    throw std::runtime_error("Error: The serialized microphone does not have the expected number of histograms");
+  for (auto &hist : mic.histograms)
+  {
+    hist = read_histogram(in);
+    if (hist.get_array().rows() != n_bands)
+      throw std::runtime_error("Error: The serialized histogram does not have the number of bands of the microphone");
+  }
+
+  return mic;
+}
+
+template<size_t D>
+void write_room(ByteWriter &out, const Room<D> &room, bool results)
+{
+  /*
+   * Writes the geometry, the materials and the parameters of the room. The
+   * image sources of the last run and the histograms of the microphones are
+   * only written with results, otherwise the microphones are written by their
+   * locations and get empty histograms when the room is read.
+   */
+  out.write<uint8_t>(room.is_shoebox);
+  if (room.is_shoebox)
+  {
+    out.write_dense(room.shoebox_size);
+    out.write_dense(room.shoebox_absorption);
+    out.write_dense(room.shoebox_scattering);
+  }
+  else
+  {
+    out.write<uint64_t>(room.walls.size());
+    for (auto &wall : room.walls)
+      write_wall(out, wall);
+    out.write_vector(room.obstructing_walls);
+  }
+
+  out.write<float>(room.sound_speed);
+  out.write<int32_t>(room.ism_order);
+  out.write<float>(room.energy_thres);
+  out.write<float>(room.time_thres);
+  out.write<float>(room.mic_radius);
+  out.write<float>(room.mic_hist_res);
+  out.write<uint8_t>(room.is_hybrid_sim);
+
+  out.write<int32_t>(room.n_threads);
+  out.write<int32_t>(room.ray_packet_size);
+  out.write<float>(room.visibility_patch_size);
+  out.write<int32_t>(room.ism_n_threads);
+  out.write<float>(room.ism_max_distance);
+  out.write<uint8_t>(room.ism_beam_pruning);
+  out.write<uint8_t>(room.ism_keep_tree);
+
+  out.write<uint8_t>(results);
+  out.write<uint64_t>(room.microphones.size());
+  for (auto &mic : room.microphones)
+  {
+    if (results)
+      write_microphone(out, mic);
+    else
+      out.write_dense(mic.loc);
+  }
+
+  if (results)
+  {
+    out.write_dense(room.sources);
+    out.write_dense(room.gen_walls);
+    out.write_dense(room.orders);
+    out.write_dense(room.orders_xyz);
+    out.write_dense(room.attenuations);
+    out.write_dense(room.visible_mics);
+  }
+}
+
+template<size_t D>
+std::unique_ptr<Room<D>> read_room(ByteReader &in)
+{
+  bool is_shoebox = in.read<uint8_t>();
+
+  Vectorf<D> size;
+  Eigen::Array<float,Eigen::Dynamic,2*D> absorption, scattering;
+  std::vector<Wall<D>> walls;
+  std::vector<int> obstructing_walls;
+
+  if (is_shoebox)
+  {
+    in.read_dense(size);
+    in.read_dense(absorption);
+    in.read_dense(scattering);
+  }
+  else
+  {
+    uint64_t n_walls = in.read<uint64_t>();
+    for (uint64_t w = 0 ; w < n_walls ; w++)
+      walls.push_back(read_wall<D>(in));
+    obstructing_walls = in.read_vector<int>();
+
+    for (auto w : obstructing_walls)
+      if (w < 0 || w >= int(n_walls))
+        throw std::runtime_error("Error: The serialized room has an obstructing wall out of range");
+  }
+
+  float sound_speed = in.read<float>();
+  int ism_order = in.read<int32_t>();
+  float energy_thres = in.read<float>();
+  float time_thres = in.read<float>();
+  float mic_radius = in.read<float>();
+  float mic_hist_res = in.read<float>();
+  bool is_hybrid_sim = in.read<uint8_t>();
+
+  std::unique_ptr<Room<D>> room;
+  if (is_shoebox)
+    room.reset(new Room<D>(size, absorption, scattering, std::vector<Microphone<D>>(),
+          sound_speed, ism_order, energy_thres, time_thres, mic_radius, mic_hist_res, is_hybrid_sim));
+  else
+    room.reset(new Room<D>(walls, obstructing_walls, std::vector<Microphone<D>>(),
+          sound_speed, ism_order, energy_thres, time_thres, mic_radius, mic_hist_res, is_hybrid_sim));
+
+  room->set_n_threads(in.read<int32_t>());
+  room->set_ray_packet_size(in.read<int32_t>());
+  room->set_visibility_patch_size(in.read<float>());
+  room->set_ism_n_threads(in.read<int32_t>());
+  room->set_ism_max_distance(in.read<float>());
+  room->set_ism_beam_pruning(in.read<uint8_t>());
+  room->set_ism_keep_tree(in.read<uint8_t>());
+
+  bool results = in.read<uint8_t>();
+  uint64_t n_mics = in.read<uint64_t>();
+  for (uint64_t m = 0 ; m < n_mics ; m++)
+  {
+    if (results)
+    {
+      /* the histograms must be the ones the room would log into */
+      Microphone<D> mic = read_microphone<D>(in);
+      if (mic.n_bands != int(room->n_bands)
+          || mic.hist_resolution != room->mic_hist_res * room->sound_speed)
+        throw std::runtime_error("Error: The serialized microphone does not match the bands or the resolution of the room");
+      room->microphones.push_back(mic);
+    }
+    else
+    {
+      Vectorf<D> loc;
+      in.read_dense(loc);
+      room->add_mic(loc);
+    }
+  }
+
+  if (results)
+  {
+    in.read_dense(room->sources);
+    in.read_dense(room->gen_walls);
+    in.read_dense(room->orders);
+    in.read_dense(room->orders_xyz);
+    in.read_dense(room->attenuations);
+    in.read_dense(room->visible_mics);
+
+    /*
+     * The image sources are the columns of every array. The arrays are
+     * empty before the first run and after release_image_sources.
+     */
+    Eigen::Index n_sources = room->sources.cols();
+    bool empty = n_sources == 0;
+    if (room->gen_walls.size() != n_sources
+        || room->orders.size() != n_sources
+        || (room->orders_xyz.cols() != n_sources && room->orders_xyz.cols() != 0)
+        || room->attenuations.cols() != n_sources
+        || room->visible_mics.cols() != n_sources
+        || (!empty && room->attenuations.rows() != Eigen::Index(room->n_bands))
+        || (!empty && room->visible_mics.rows() != Eigen::Index(room->microphones.size())))
+      throw std::runtime_error("Error: The serialized image sources do not have consistent sizes");
+  }
+
+  return room;
+}
+
+/*
+ * The objects are serialized to and from a string of bytes with a header.
+ * These are the functions bound to python.
+ */
+
+template<size_t D>
+std::string wall_to_bytes(const Wall<D> &wall)
+{
+  ByteWriter out;
+  out.write_header(SerialKind::WALL, D);
+  write_wall(out, wall);
+  return out.bytes();
+}
+
+template<size_t D>
+Wall<D> wall_from_bytes(const std::string &bytes)
+{
+  ByteReader in(bytes);
+  in.read_header(SerialKind::WALL, D);
+  Wall<D> wall = read_wall<D>(in);
+  in.check_end();
+  return wall;
+}
+
+inline std::string histogram_to_bytes(const Histogram2D &hist)
+{
+  ByteWriter out;
+  out.write_header(SerialKind::HISTOGRAM, 2);
+  write_histogram(out, hist);
+  return out.bytes();
+}
+
+inline Histogram2D histogram_from_bytes(const std::string &bytes)
+{
+  ByteReader in(bytes);
+  in.read_header(SerialKind::HISTOGRAM, 2);
+  Histogram2D hist = read_histogram(in);
+  in.check_end();
+  return hist;
+}
+
+template<size_t D>
+std::string microphone_to_bytes(const Microphone<D> &mic)
+{
+  ByteWriter out;
+  out.write_header(SerialKind::MICROPHONE, D);
+  write_microphone(out, mic);
+  return out.bytes();
+}
+
+template<size_t D>
+Microphone<D> microphone_from_bytes(const std::string &bytes)
+{
+  ByteReader in(bytes);
+  in.read_header(SerialKind::MICROPHONE, D);
+  Microphone<D> mic = read_microphone<D>(in);
+  in.check_end();
+  return mic;
+}
+
+template<size_t D>
+std::string room_to_bytes(const Room<D> &room, bool results)
+{
+  ByteWriter out;
+  out.write_header(SerialKind::ROOM, D);
+  write_room(out, room, results);
+  return out.bytes();
+}
+
+template<size_t D>
+std::unique_ptr<Room<D>> room_from_bytes(const std::string &bytes)
+{
+  ByteReader in(bytes);
+  in.read_header(SerialKind::ROOM, D);
+  std::unique_ptr<Room<D>> room = read_room<D>(in);
+  in.check_end();
+  return room;
+}
+
+#endif // __SERIALIZE_HPP__
@@ -0,0 +1,288 @@
+/*
+ * Visibility of the receivers from patches of the walls
+ * Copyright (C) 2019  Robin Scheibler, Cyril Cadoux
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * You should have received a copy of the MIT License along with this program. If
+ * not, see <https://opensource.org/licenses/MIT>.
+ */
+#ifndef __VISIBILITY_HPP__
+#define __VISIBILITY_HPP__
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <Eigen/Dense>
+
+#include "common.hpp"
+#include "wall.hpp"
+#include "microphone.hpp"
+#include "beam.hpp"
+#include "parallel.hpp"
+
+template<size_t D>
+class PatchVisibility
+{
+  /*
+   * Potentially visible sets of the receivers from the walls of a room.
+   *
+   * Every wall with scattering is divided in square patches (segments in
+   * 2D) of a given size. A patch is marked visible from a receiver when no
+   * obstructing wall meets the pyramid (triangle in 2D) between the receiver
+   * and the patch, and occluded when a single convex obstructing wall cuts
+   * the segments from all the corners of the patch to the receiver. Both
+   * hold for the whole square, including the parts that are outside of a
+   * non-rectangular wall. Otherwise the patch is marked unknown and the
+   * visibility has to be checked by casting a ray.
+   *
+   * The side of the walls where the receivers are is stored too.
+   */
+  struct Grid
+  {
+    Vectorf<D> origin;
+    Eigen::Matrix<float, D, 2> axes;  // the axes of the grid in the plane of the wall
+    float u_min = 0.f, v_min = 0.f, u_max = 0.f, v_max = 0.f;
+    int n_u = 0, n_v = 0;  // zero for walls without a grid
+    int first = 0;  // index of the first patch of the wall
+  };
+
+  float patch_size = 0.f;
+  std::vector<Vectorf<D>> locs;  // the receivers used to build the table
+  std::vector<Grid> grids;
+  std::vector<int> sides;  // index: wall * n_receivers + receiver
+  std::vector<unsigned char> states;  // index: patch * n_receivers + receiver
+
+  public:
+    enum State { UNKNOWN = 0, VISIBLE = 1, OCCLUDED = 2 };
+
+    bool empty() const { return grids.size() == 0; }
+
+    void clear()
+    {
+      patch_size = 0.f;
+      locs.clear();
+      grids.clear();
+      sides.clear();
+      states.clear();
+    }
+
+    bool is_built_for(const std::vector<Microphone<D>> &receivers, float _patch_size) const
+    {
+      if (empty() || patch_size != _patch_size || locs.size() != receivers.size())
+        return false;
+
+      for (size_t k = 0 ; k < receivers.size() ; k++)
+        if (locs[k] != receivers[k].get_loc())
+          return false;
+
+      return true;
+    }
+
+    void build(
+        const std::vector<Wall<D>> &walls,
+        const std::vector<int> &obstructing_walls,
+        const std::vector<Microphone<D>> &receivers,
+        float _patch_size,
+        int n_threads
+        );
+
+    int side(int wall_id, int k) const
+    {
+      return sides[wall_id * locs.size() + k];
+    }
+
+    int state(int wall_id, const Vectorf<D> &p, int k) const
+    {
+      /*
+       * The visibility of receiver k from the patch of the wall where p lies
+       */
+      const Grid &g = grids[wall_id];
+      if (g.n_u == 0)
+        return UNKNOWN;
+
+      Eigen::Vector2f flat = g.axes.adjoint() * (p - g.origin);
+      int iu = std::min(std::max(int((flat[0] - g.u_min) / patch_size), 0), g.n_u - 1);
+      int iv = std::min(std::max(int((flat[1] - g.v_min) / patch_size), 0), g.n_v - 1);
+
+      return states[(g.first + iu * g.n_v + iv) * locs.size() + k];
+    }
+};
+
+template<size_t D>
+void PatchVisibility<D>::build(
+    const std::vector<Wall<D>> &walls,
+    const std::vector<int> &obstructing_walls,
+    const std::vector<Microphone<D>> &receivers,
+    float _patch_size,
+    int n_threads
+    )
+{
+  /*
+   * walls: the walls of the room
+   * obstructing_walls: the indices of the walls that can obstruct a ray
+   * receivers: the receivers
+   * _patch_size: the size of the side of the patches
+   * n_threads: the number of threads used to build the table
+   */
+  clear();
+  patch_size = _patch_size;
+
+  size_t n_rx = receivers.size();
+  for (auto &rx : receivers)
+    locs.push_back(rx.get_loc());
+
+  sides.resize(walls.size() * n_rx);
+  grids.resize(walls.size());
+
+  int n_patches = 0;
+  for (size_t w = 0 ; w < walls.size() ; w++)
+  {
+    const Wall<D> &wall = walls[w];
+    Grid &g = grids[w];
+
+    for (size_t k = 0 ; k < n_rx ; k++)
+      sides[w * n_rx + k] = wall.side(locs[k]);
+
+    // only the walls with scattering are queried
+    if (wall.scatter.maxCoeff() <= 0.f)
+      continue;
+
+    g.origin = wall.origin;
+    g.axes.setZero();
+
+    Eigen::Matrix<float, 2, Eigen::Dynamic> flat;
+    if (D == 2)
+    {
+      g.axes.col(0) = (wall.corners.col(1) - wall.corners.col(0)).normalized();
+      flat = g.axes.adjoint() * (wall.corners.colwise() - g.origin);
+    }
+    else
+    {
+      g.axes = wall.basis;
+      flat = wall.flat_corners;
+    }
+
+    Eigen::Vector2f f_min = flat.rowwise().minCoeff();
+    Eigen::Vector2f f_max = flat.rowwise().maxCoeff();
+
+    g.u_min = f_min[0];
+    g.v_min = f_min[1];
+    g.u_max = f_max[0];
+    g.v_max = f_max[1];
+    g.n_u = std::max(1, int(std::ceil((f_max[0] - f_min[0]) / patch_size)));
+    g.n_v = std::max(1, int(std::ceil((f_max[1] - f_min[1]) / patch_size)));
+    g.first = n_patches;
+
+    n_patches += g.n_u * g.n_v;
+  }
+
+  states.resize(n_patches * n_rx);
+
+  // The convex hulls of the obstructing walls and their bounding boxes
+  // are tested against the pyramids, only the convex walls can occlude
+  // a whole patch
+  size_t n_obst = obstructing_walls.size();
+  std::vector<std::vector<Vectorf<D>>> hulls(n_obst);
+  std::vector<Vectorf<D>> h_min(n_obst), h_max(n_obst);
+  std::vector<bool> convex(n_obst);
+  for (size_t o = 0 ; o < n_obst ; o++)
+  {
+    const Wall<D> &wall = walls[obstructing_walls[o]];
+    hulls[o] = wall_hull(wall);
+    convex[o] = hulls[o].size() == size_t(wall.corners.cols());
+    h_min[o] = wall.corners.rowwise().minCoeff();
+    h_max[o] = wall.corners.rowwise().maxCoeff();
+  }
+
+  // the corners of a patch, relative to its first corner and in order
+  // the ones of the last row and column of patches are clipped to the grid
+  std::vector<Eigen::Vector2f> offsets;
+  if (D == 2)
+    offsets = { {0.f, 0.f}, {1.f, 0.f} };
+  else
+    offsets = { {0.f, 0.f}, {1.f, 0.f}, {1.f, 1.f}, {0.f, 1.f} };
+
+  float tol = 10.f * libroom_eps;
+
+  parallel_for(walls.size(), n_threads,
+      [&](size_t w)
+      {
+        const Grid &g = grids[w];
+        Beam<D> pyramid;
+        std::vector<Vectorf<D>> clipped, buffer;
+        Vectorf<D> hit;
+
+        for (int iu = 0 ; iu < g.n_u ; iu++)
+          for (int iv = 0 ; iv < g.n_v ; iv++)
+          {
+            size_t patch = g.first + iu * g.n_v + iv;
+
+            pyramid.aperture.clear();
+            for (auto &c : offsets)
+            {
+              Eigen::Vector2f flat(
+                  std::min(g.u_min + (iu + c[0]) * patch_size, g.u_max),
+                  std::min(g.v_min + (iv + c[1]) * patch_size, g.v_max)
+                  );
+              pyramid.aperture.push_back(g.origin + g.axes * flat);
+            }
+
+            for (size_t k = 0 ; k < n_rx ; k++)
+            {
+              pyramid.build(locs[k], walls[w], tol, false);
+
+              Vectorf<D> p_min = locs[k], p_max = locs[k];
+              for (auto &c : pyramid.aperture)
+              {
+                p_min = p_min.cwiseMin(c);
+                p_max = p_max.cwiseMax(c);
+              }
+
+              int state = VISIBLE;
+              for (size_t o = 0 ; o < n_obst ; o++)
+              {
+                if (obstructing_walls[o] == int(w)
+                    || (h_min[o].array() > p_max.array() + tol).any()
+                    || (h_max[o].array() < p_min.array() - tol).any()
+                    || !pyramid.clip(hulls[o], clipped, buffer))
+                  continue;
+
+                state = UNKNOWN;
+
+                // the wall cuts the segments to all the corners
+                bool occludes = convex[o];
+                for (size_t c = 0 ; occludes && c < pyramid.aperture.size() ; c++)
+                  occludes = walls[obstructing_walls[o]].intersection(pyramid.aperture[c], locs[k], hit) == 0;
+
+                if (occludes)
+                {
+                  state = OCCLUDED;
+                  break;
+                }
+              }
+
+              states[patch * n_rx + k] = state;
+            }
+          }
+      }
+      );
+}
+
+#endif // __VISIBILITY_HPP__
@@ -0,0 +1,277 @@
+/*
+ * Packed copy of the wall geometry for vectorized intersection tests
+ * Copyright (C) 2019  Robin Scheibler, Cyril Cadoux
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * You should have received a copy of the MIT License along with this program. If
+ * not, see <https://opensource.org/licenses/MIT>.
+ */
+#ifndef __WALL_CACHE_HPP__
+#define __WALL_CACHE_HPP__
+
+#include <vector>
+#include <cmath>
+#include <Eigen/Dense>
+
+#include "common.hpp"
+#include "geometry.hpp"
+#include "wall.hpp"
+
+template<size_t D>
+class WallCache
+{
+  /*
+   * A structure-of-arrays copy of the geometry of a list of walls.
+   *
+   * Every coordinate of the planes (3D) or segments (2D) is stored in its
+   * own contiguous array so that a segment is tested against a block of
+   * walls with loops over the walls that the compiler vectorizes. Only the
+   * polygon test of the 3D walls crossed by the segment is done wall by
+   * wall, on the packed flat corners.
+   *
+   * The results are the same as the ones of Wall::intersection.
+   */
+  static const int block_size = 16;
+
+  std::vector<int> ids;  // index of the wall stored in every slot
+
+  // The first corner of the walls (i.e. their origin), the second corner
+  // of the 2D walls, and the normal and basis of the plane of the 3D walls
+  std::vector<float> origin[D], end[D], normal[D], basis[2][D];
+
+  // 3D: the flat corners of all the walls, one after the other
+  Eigen::Matrix<float, 2, Eigen::Dynamic> flat_corners;
+  std::vector<int> corners_first, corners_count;
+
+  int block(const Vectorf<D> &p1, const Vectorf<D> &p2, int first, int count,
+      int *ret, float hit[D][block_size]) const;
+
+  public:
+    void build(const std::vector<Wall<D>> &walls, const std::vector<int> &order);
+
+    int size() const { return ids.size(); }
+
+    template<class Func>
+    bool intersect(
+        const Vectorf<D> &p1,
+        const Vectorf<D> &p2,
+        int first,
+        int count,
+        const Func &visit
+        ) const
+    {
+      /*
+       * Tests the segment (p1, p2) against the walls in the slots
+       * first, ..., first + count - 1.
+       *
+       * visit: a function called as visit(wall_id, ret, hit) for every wall
+       *   intersected, in the order of the slots, where ret and hit are the
+       *   return value and intersection point of Wall::intersection.
+       *   It returns true to stop the search.
+       *
+       * :returns: true if the search was stopped by visit
+       */
+      int ret[block_size];
+      float hit[D][block_size];
+      Vectorf<D> hit_point;
+
+      for (int start = first ; start < first + count ; start += block_size)
+      {
+        int n = std::min(block_size, first + count - start);
+        if (block(p1, p2, start, n, ret, hit) == 0)
+          continue;
+
+        for (int i = 0 ; i < n ; i++)
+        {
+          if (ret[i] < 0)
+            continue;
+
+          for (size_t d = 0 ; d < D ; d++)
+            hit_point[d] = hit[d][i];
+
+          if (visit(ids[start + i], ret[i], hit_point))
+            return true;
+        }
+      }
+
+      return false;
+    }
+};
+
+// std::min takes the block size by reference, it needs a definition
+template<size_t D>
+const int WallCache<D>::block_size;
+
+template<size_t D>
+void WallCache<D>::build(const std::vector<Wall<D>> &walls, const std::vector<int> &order)
+{
+  /*
+   * Packs the walls in the order given, i.e., wall order[i] is stored in slot i
+   */
+  ids = order;
+
+  for (size_t d = 0 ; d < D ; d++)
+  {
+    origin[d].resize(ids.size());
+    end[d].resize(ids.size());
+    normal[d].resize(ids.size());
+    basis[0][d].resize(ids.size());
+    basis[1][d].resize(ids.size());
+  }
+  corners_first.resize(ids.size());
+  corners_count.resize(ids.size());
+
+  int n_corners = 0;
+  for (size_t i = 0 ; i < ids.size() ; i++)
+  {
+    const Wall<D> &w = walls[ids[i]];
+
+    for (size_t d = 0 ; d < D ; d++)
+    {
+      origin[d][i] = w.origin[d];
+      end[d][i] = D == 2 ? w.corners.coeff(d, 1) : 0.f;
+      normal[d][i] = w.normal[d];
+      basis[0][d][i] = D == 3 ? w.basis.coeff(d, 0) : 0.f;
+      basis[1][d][i] = D == 3 ? w.basis.coeff(d, 1) : 0.f;
+    }
+
+    corners_first[i] = n_corners;
+    corners_count[i] = D == 3 ? w.flat_corners.cols() : 0;
+    n_corners += corners_count[i];
+  }
+
+  flat_corners.resize(2, n_corners);
+  for (size_t i = 0 ; i < ids.size() ; i++)
+    if (corners_count[i] > 0)
+      flat_corners.middleCols(corners_first[i], corners_count[i]) = walls[ids[i]].flat_corners;
+}
+
+template<>
+inline int WallCache<2>::block(
+    const Vectorf<2> &p1, const Vectorf<2> &p2, int first, int n,
+    int *ret, float hit[2][block_size]) const
+{
+  /*
+   * Same as intersection_2d_segments with segment a = (p1, p2) and the
+   * walls as segments b. The ccw3p orientations are computed as in ccw3p.
+   */
+  const float eps = libroom_eps;
+  const float *b1x = &origin[0][first], *b1y = &origin[1][first];
+  const float *b2x = &end[0][first], *b2y = &end[1][first];
+
+  float a1x = p1[0], a1y = p1[1], a2x = p2[0], a2y = p2[1];
+
+  // normal to the segment a
+  float nx = a1y - a2y, ny = a2x - a1x;
+
+  auto sign = [eps](float d) { return int(d >= eps) - int(d <= -eps); };
+
+  int n_hits = 0;
+  for (int i = 0 ; i < n ; i++)
+  {
+    int a1a2b1 = sign((a2x - a1x) * (b1y[i] - a1y) - (b1x[i] - a1x) * (a2y - a1y));
+    int a1a2b2 = sign((a2x - a1x) * (b2y[i] - a1y) - (b2x[i] - a1x) * (a2y - a1y));
+    int b1b2a1 = sign((b2x[i] - b1x[i]) * (a1y - b1y[i]) - (a1x - b1x[i]) * (b2y[i] - b1y[i]));
+    int b1b2a2 = sign((b2x[i] - b1x[i]) * (a2y - b1y[i]) - (a2x - b1x[i]) * (b2y[i] - b1y[i]));
+
+    float dbx = b2x[i] - b1x[i], dby = b2y[i] - b1y[i];
+    float denom = nx * dbx + ny * dby;
+    float ratio = (nx * (a1x - b1x[i]) + ny * (a1y - b1y[i])) / denom;
+
+    hit[0][i] = ratio * dbx + b1x[i];
+    hit[1][i] = ratio * dby + b1y[i];
+
+    bool valid = (a1a2b1 != a1a2b2) & (b1b2a1 != b1b2a2) & (std::abs(denom) >= eps);
+    int flags = int((b1b2a1 == 0) | (b1b2a2 == 0)) | (int((a1a2b1 == 0) | (a1a2b2 == 0)) << 1);
+
+    ret[i] = valid ? flags : -1;
+    n_hits += valid;
+  }
+
+  return n_hits;
+}
+
+template<>
+inline int WallCache<3>::block(
+    const Vectorf<3> &p1, const Vectorf<3> &p2, int first, int n,
+    int *ret, float hit[3][block_size]) const
+{
+  /*
+   * Same as Wall<3>::intersection. The intersection with the planes is
+   * computed for the whole block, then the walls crossed are checked
+   * with is_inside_2d_polygon.
+   */
+  const float eps = libroom_eps;
+  const float *ox = &origin[0][first], *oy = &origin[1][first], *oz = &origin[2][first];
+  const float *nx = &normal[0][first], *ny = &normal[1][first], *nz = &normal[2][first];
+
+  float ux = p2[0] - p1[0], uy = p2[1] - p1[1], uz = p2[2] - p1[2];
+
+  int n_hits = 0;
+  for (int i = 0 ; i < n ; i++)
+  {
+    // same as intersection_3d_segment_plane
+    float denom = nx[i] * ux + ny[i] * uy + nz[i] * uz;
+    float num = -nx[i] * (p1[0] - ox[i]) - ny[i] * (p1[1] - oy[i]) - nz[i] * (p1[2] - oz[i]);
+    float s = num / denom;
+
+    hit[0][i] = s * ux + p1[0];
+    hit[1][i] = s * uy + p1[1];
+    hit[2][i] = s * uz + p1[2];
+
+    bool valid = (std::abs(denom) > eps) & (-eps <= s) & (s <= 1 + eps);
+    int endpoint = int((std::abs(s) < eps) | (std::abs(s - 1) < eps));
+
+    ret[i] = valid ? endpoint : -1;
+    n_hits += valid;
+  }
+
+  if (n_hits == 0)
+    return 0;
+
+  for (int i = 0 ; i < n ; i++)
+  {
+    if (ret[i] < 0)
+      continue;
+
+    // project the intersection in the basis of the plane and check the polygon
+    int k = first + i;
+    Eigen::Vector2f flat;
+    for (int c = 0 ; c < 2 ; c++)
+      flat[c] = basis[c][0][k] * (hit[0][i] - ox[i])
+        + basis[c][1][k] * (hit[1][i] - oy[i])
+        + basis[c][2][k] * (hit[2][i] - oz[i]);
+
+    int inside = is_inside_2d_polygon(flat,
+        flat_corners.middleCols(corners_first[k], corners_count[k]));
+
+    if (inside < 0)
+    {
+      ret[i] = -1;
+      n_hits--;
+    }
+    else if (inside == 1)
+      ret[i] |= 2;
+  }
+
+  return n_hits;
+}
+
+#endif // __WALL_CACHE_HPP__
@@ -764,6 +764,38 @@ def find_non_convex_walls(walls):
     return [i for i in range(len(walls)) if not in_convex_hull[i]]
 
 
+def find_non_convex_faces(vertices, faces, tol=1e-5):
+    """
+    Finds the faces of a mesh that are not in the convex hull
+
+    Parameters
+    ----------
+    vertices: ndarray (dim, n_vertices)
+        The corners of the faces
+    faces: ndarray (n_faces, max_corners) of int
+        The indices of the corners of every face, padded with negative values
+    tol: float, optional
+        The distance under which the center of a face is on a face of the hull
+
+    Returns
+    -------
+    list of int
+        The indices of the faces not in the convex hull
+    """
+    valid = faces >= 0
+    corners = vertices[:, np.where(valid, faces, 0)] * valid
+    centers = corners.sum(axis=-1) / valid.sum(axis=-1)
+
+    # the planes of the hull, the simplices of a flat side share the same one
+    convex_hull = spatial.ConvexHull(vertices[:, np.unique(faces[valid])].T)
+    planes = np.unique(np.round(convex_hull.equations, decimals=6), axis=0)
+
+    dist = np.abs(centers.T @ planes[:, :-1].T + planes[:, -1])
+    in_convex_hull = np.any(dist < tol, axis=1)
+
+    return np.flatnonzero(~in_convex_hull).tolist()
+
+
 class Room(object):
     """
     A Room object has as attributes a collection of
@@ -777,6 +809,9 @@ class Room(object):
     common plane. Creating rooms in 3D is more tedious and for convenience a method
     :py:func:`pyroomacoustics.room.Room.extrude` is provided to lift a 2D room
     into 3D space by adding vertical walls and parallel floor and ceiling.
+    Rooms imported from meshes are best created with
+    :py:func:`pyroomacoustics.room.Room.from_mesh`, from arrays of vertices and
+    faces.
 
     The Room is sub-classed by :py:obj:`pyroomacoustics.room.ShoeBox` which
     creates a rectangular (2D) or parallelepipedic (3D) room. Such rooms
@@ -916,6 +951,15 @@ class Room(object):
         self.octave_bands = OctaveBandsFactory(fs=self.fs)
         self.max_rand_disp = max_rand_disp
 
+        # default values for the image source model parameters
+        self.ism_args = {
+            "n_threads": 1,
+            "max_distance": 0.0,
+            "beam_pruning": False,
+            "fused_rir": False,
+            "keep_tree": False,
+        }
+
         # Keep track of the state of the simulator
         self.simulator_state = {
             "ism_needed": (self.max_order >= 0),
@@ -982,6 +1026,14 @@ class Room(object):
         else:
             self.room_engine = libroom.Room(*args)
 
+        self.room_engine.n_threads = self.rt_args["n_threads"]
+        self.room_engine.ray_packet_size = self.rt_args["ray_packet_size"]
+        self.room_engine.visibility_patch_size = self.rt_args["visibility_patch_size"]
+        self.room_engine.ism_n_threads = self.ism_args["n_threads"]
+        self.room_engine.ism_max_distance = self.ism_args["max_distance"]
+        self.room_engine.ism_beam_pruning = self.ism_args["beam_pruning"]
+        self.room_engine.ism_keep_tree = self.ism_args["keep_tree"]
+
     def _update_room_engine_params(self):
 
         # Now, if it exists, set the parameters of room engine
@@ -998,6 +1050,15 @@ class Room(object):
                     and self.simulator_state["rt_needed"]
                 ),
             )
+            self.room_engine.n_threads = self.rt_args["n_threads"]
+            self.room_engine.ray_packet_size = self.rt_args["ray_packet_size"]
+            self.room_engine.visibility_patch_size = self.rt_args[
+                "visibility_patch_size"
+            ]
+            self.room_engine.ism_n_threads = self.ism_args["n_threads"]
+            self.room_engine.ism_max_distance = self.ism_args["max_distance"]
+            self.room_engine.ism_beam_pruning = self.ism_args["beam_pruning"]
+            self.room_engine.ism_keep_tree = self.ism_args["keep_tree"]
 
     @property
     def is_multi_band(self):
@@ -1014,6 +1075,10 @@ class Room(object):
         energy_thres=1e-7,
         time_thres=10.0,
         hist_bin_size=0.004,
+        n_threads=1,
+        ray_packet_size=1,
+        visibility_patch_size=None,
+        reciprocal=False,
     ):
         """
         Activates the ray tracer.
@@ -1031,6 +1096,29 @@ class Room(object):
             The maximum time of flight of rays (default: 10 s)
         hist_bin_size: float
             The time granularity of bins in the energy histogram (default: 4 ms)
+        n_threads: int, optional
+            The number of threads used to trace the rays. When set to 0, all
+            the available cores are used (default: 1). For a given number of
+            threads, the result of the simulation is reproducible.
+        ray_packet_size: int, optional
+            In shoebox rooms, the rays can be traced by packets of 4, 8, or 16
+            using SIMD instructions. The result differs from the one obtained
+            when tracing the rays one by one (the default, 1) only by floating
+            point rounding.
+        visibility_patch_size: float, optional
+            In non-convex rooms, the walls can be divided in patches of this
+            size (in meters) and the visibility of the microphones from every
+            patch is computed once. The scattered rays then use this table
+            instead of checking the obstructions, except close to the edges
+            of the shadows. The result is the same as without the table
+            (default: None, the table is not used).
+        reciprocal: bool, optional
+            When True, the rays are traced from the microphones and the energy
+            is collected in spheres of radius ``receiver_radius`` around the
+            sources, using the reciprocity of the propagation. The cost of the
+            simulation then grows with the number of microphones instead of the
+            number of sources, which is faster when there are more sources than
+            microphones (default: False).
         """
         self._set_ray_tracing_options(
             use_ray_tracing=True,
@@ -1039,6 +1127,10 @@ class Room(object):
             energy_thres=energy_thres,
             time_thres=time_thres,
             hist_bin_size=hist_bin_size,
+            n_threads=n_threads,
+            ray_packet_size=ray_packet_size,
+            visibility_patch_size=visibility_patch_size,
+            reciprocal=reciprocal,
         )
 
     def _set_ray_tracing_options(
@@ -1049,6 +1141,10 @@ class Room(object):
         energy_thres=1e-7,
         time_thres=10.0,
         hist_bin_size=0.004,
+        n_threads=1,
+        ray_packet_size=1,
+        visibility_patch_size=None,
+        reciprocal=False,
         is_init=False,
     ):
         """
@@ -1075,6 +1171,12 @@ class Room(object):
         self.rt_args["time_thres"] = time_thres
         self.rt_args["receiver_radius"] = receiver_radius
         self.rt_args["hist_bin_size"] = hist_bin_size
+        self.rt_args["n_threads"] = n_threads
+        self.rt_args["ray_packet_size"] = ray_packet_size
+        self.rt_args["visibility_patch_size"] = (
+            0.0 if visibility_patch_size is None else visibility_patch_size
+        )
+        self.rt_args["reciprocal"] = reciprocal
 
         # set the histogram bin size so that it is an integer number of samples
         self.rt_args["hist_bin_size_samples"] = math.floor(
@@ -1120,6 +1222,60 @@ class Room(object):
 
         self._update_room_engine_params()
 
+    def set_image_source_options(
+        self,
+        n_threads=1,
+        max_distance=None,
+        beam_pruning=False,
+        fused_rir=False,
+        keep_tree=False,
+    ):
+        """
+        Sets the parameters of the image source model.
+
+        Parameters
+        ----------
+        n_threads: int, optional
+            The number of threads used to compute the image sources. When set
+            to 0, all the available cores are used (default: 1). The image
+            sources found are the same, in the same order, for any number of
+            threads.
+        max_distance: float, optional
+            Only the image sources seen by a microphone closer than this
+            distance (in meters) are kept. The image sources farther than this
+            from all the microphones are not searched, nor the ones obtained by
+            reflecting them further. For example, ``c * t`` limits the image
+            sources to the first ``t`` seconds of the impulse responses
+            (default: None, no limit).
+        beam_pruning: bool, optional
+            If True, the search of the image sources of polygonal rooms keeps
+            track of the part of the walls that the paths through every image
+            source can reach, and does not reflect an image source across the
+            walls outside of it. This gives the same image sources and is
+            much faster at high orders (default: False).
+        fused_rir: bool, optional
+            If True, the image source part of the impulse responses of shoebox
+            rooms is built directly by the engine in ``compute_rir``, without
+            storing the image sources. The memory needed does not grow with
+            the number of image sources, but the attributes ``images``,
+            ``damping``, etc, of the sources are not set. This is only used
+            when there are no directivities and the randomized image source
+            method is not used (default: False).
+        keep_tree: bool, optional
+            If True, the image sources found for every source, visible or not,
+            are kept so that :py:meth:`move_microphones` only recomputes their
+            visibility from the new microphones instead of running the image
+            source model again. This is not possible with ``max_distance``
+            in polygonal rooms (default: False).
+        """
+        self.ism_args["n_threads"] = n_threads
+        self.ism_args["max_distance"] = 0.0 if max_distance is None else max_distance
+        self.ism_args["beam_pruning"] = beam_pruning
+        self.ism_args["fused_rir"] = fused_rir
+        self.ism_args["keep_tree"] = keep_tree
+
+        self._update_room_engine_params()
+
     def unset_ray_tracing(self):
         """Deactivates the ray tracer"""
         self.simulator_state["rt_needed"] = False
@@ -1308,6 +1464,149 @@ class Room(object):
             **kwargs,
         )
 
+    @classmethod
+    def from_mesh(
+        cls,
+        vertices,
+        faces,
+        materials=None,
+        absorption=None,
+        scattering=None,
+        fs=8000,
+        t0=0.0,
+        max_order=1,
+        sigma2_awgn=None,
+        sources=None,
+        mics=None,
+        temperature=None,
+        humidity=None,
+        air_absorption=False,
+        ray_tracing=False,
+        use_rand_ism=False,
+        max_rand_disp=0.08,
+    ):
+        """
+        Creates a room from a mesh given by arrays of vertices and faces.
+        The walls are all built by the engine in one pass, instead of creating
+        one wall object per face, which is much faster for the rooms imported
+        from meshes with many faces.
+
+        Parameters
+        ----------
+        vertices: (np.array dim x n_vertices)
+            The corners of the faces, in 2D or 3D
+        faces: (np.array n_faces x max_corners) of int
+            The indices of the corners of every face, in order. The faces with
+            fewer corners are padded with negative values. In 2D, every face
+            is a segment with two corners.
+        materials: Material or list of Material, optional
+            The material of all the faces, or one material per face
+        absorption: array_like, optional
+            The energy absorption of every face, of shape ``(n_faces,)``, or
+            ``(n_bands, n_faces)`` with one value per octave band. It is only
+            used when ``materials`` is not provided. Default is 0.
+        scattering: array_like, optional
+            The scattering of every face, with the same shapes as
+            ``absorption``. Default is 0.
+        fs: int, optional
+            The sampling frequency in Hz. Default is 8000.
+        t0: float, optional
+            The global starting time of the simulation in seconds. Default is 0.
+        max_order: int, optional
+            The maximum reflection order in the image source model. Default is 1,
+            namely direct sound and first order reflections.
+        sigma2_awgn: float, optional
+            The variance of the additive white Gaussian noise added during
+            simulation. By default, none is added.
+        sources: list of SoundSource objects, optional
+            Sources to place in the room.
+        mics: MicrophoneArray object, optional
+            The microphone array to place in the room.
+        temperature, humidity, air_absorption, ray_tracing, use_rand_ism, max_rand_disp:
+            The same as for the :py:class:`~pyroomacoustics.room.Room` class
+
+        Returns
+        -------
+        Instance of a room
+        """
+        vertices = np.array(vertices, dtype=np.float32)
+        faces = np.array(faces, dtype=np.int32)
+
+        if vertices.ndim != 2 or vertices.shape[0] not in [2, 3]:
+            raise ValueError("The vertices should be an array of 2D or 3D points.")
+        if faces.ndim != 2 or faces.shape[0] == 0:
+            raise ValueError("The faces should be an array with one face per row.")
+        n_faces = faces.shape[0]
+
+        octave_bands = OctaveBandsFactory(fs=fs)
+
+        if materials is not None:
+            if not isinstance(materials, list):
+                materials = [materials]
+            elif len(materials) != n_faces:
+                raise ValueError("One material per face is required.")
+
+            if not Material.all_flat(materials):
+                for mat in materials:
+                    mat.resample(octave_bands)
+
+            absorption = np.array([mat.absorption_coeffs for mat in materials]).T
+            scattering = np.array([mat.scattering_coeffs for mat in materials]).T
+
+        # Get the absorption and scattering as arrays
+        # shape: (n_bands, n_faces)
+        coeffs = []
+        for c in [absorption, scattering]:
+            c = np.zeros(1) if c is None else np.array(c, dtype=np.float32)
+            coeffs.append(c.reshape((1, -1)) if c.ndim < 2 else c)
+        absorption, scattering = np.broadcast_arrays(
+            coeffs[0], coeffs[1], np.zeros((1, n_faces), dtype=np.float32)
+        )[:2]
+
+        if absorption.shape[0] not in [1, octave_bands.n_bands]:
+            raise ValueError(
+                "The absorption and scattering should have one value or one per octave band."
+            )
+
+        room = cls.__new__(cls)
+        room.dim = vertices.shape[0]
+
+        room._var_init(
+            fs,
+            t0,
+            max_order,
+            sigma2_awgn,
+            temperature,
+            humidity,
+            air_absorption,
+            ray_tracing,
+            use_rand_ism,
+            max_rand_disp,
+        )
+
+        # Create the real room object, it builds the walls from the arrays
+        obstructing_walls = find_non_convex_faces(vertices, faces)
+        room._init_room_engine(
+            vertices, faces, absorption, scattering, obstructing_walls
+        )
+
+        room.walls = room.room_engine.walls
+        room._wall_mapping()
+
+        # add the sources
+        room.sources = []
+        if sources is not None and isinstance(sources, list):
+            for src in sources:
+                room.add_soundsource(src)
+
+        # add the microphone array
+        if mics is not None:
+            room.add_microphone_array(mics)
+        else:
+            room.mic_array = None
+
+        return room
+
     def extrude(self, height, v_vec=None, absorption=None, materials=None):
         """
         Creates a 3D room by extruding a 2D polygon.
@@ -2113,115 +2412,426 @@ class Room(object):
 
             n_sources = self.room_engine.image_source_model(source.position)
 
-            if n_sources > 0:
+            # keep the image sources, visible or not, to recompute their
+            # visibility when the microphones move
+            if self.ism_args["keep_tree"]:
+                source._ism_tree = self.room_engine.release_image_source_tree()
 
-                # Copy to python managed memory
-                source.images = self.room_engine.sources.copy()
-                source.orders = self.room_engine.orders.copy()
-                source.orders_xyz = self.room_engine.orders_xyz.copy()
-                source.walls = self.room_engine.gen_walls.copy()
-                source.damping = self.room_engine.attenuations.copy()
-                source.generators = -np.ones(source.walls.shape)
+            visibility = self._set_image_sources(source, n_sources)
+            if visibility is not None:
+                self.visibility.append(visibility)
 
-                # if randomized image method is selected, add a small random
-                # displacement to the image sources
-                if self.simulator_state["random_ism_needed"]:
+        # Update the state
+        self.simulator_state["ism_done"] = True
 
-                    n_images = np.shape(source.images)[1]
+    def _set_image_sources(self, source, n_sources):
+        """
+        Sets the image sources found by the room engine as attributes of the
+        source and returns their visibility from the microphones, or None if
+        there are none
+        """
 
-                    # maximum allowed displacement is 8cm
-                    max_disp = self.max_rand_disp
+        if n_sources == 0:
+            return None
 
-                    # add a random displacement to each cartesian coordinate
-                    disp = np.random.uniform(-max_disp, max_disp, size=(3, n_images))
-                    source.images += disp
+        # Move to python managed memory, without copy
+        images = self.room_engine.release_image_sources()
+        source.images = images["sources"]
+        source.orders = images["orders"]
+        source.orders_xyz = images["orders_xyz"]
+        source.walls = images["gen_walls"]
+        source.damping = images["attenuations"]
+        source.generators = -np.ones(source.walls.shape)
 
-                self.visibility.append(self.room_engine.visible_mics.copy())
+        # if randomized image method is selected, add a small random
+        # displacement to the image sources
+        if self.simulator_state["random_ism_needed"]:
 
-                # We need to check that microphones are indeed in the room
-                for m in range(self.mic_array.R.shape[1]):
-                    # if not, it's not visible from anywhere!
-                    if not self.is_inside(self.mic_array.R[:, m]):
-                        self.visibility[-1][m, :] = 0
+            n_images = np.shape(source.images)[1]
 
-        # Update the state
-        self.simulator_state["ism_done"] = True
+            # maximum allowed displacement is 8cm
+            max_disp = self.max_rand_disp
+
+            # add a random displacement to each cartesian coordinate
+            disp = np.random.uniform(-max_disp, max_disp, size=(3, n_images))
+            source.images += disp
+
+        visibility = images["visible_mics"]
+
+        # We need to check that microphones are indeed in the room
+        for m in range(self.mic_array.R.shape[1]):
+            # if not, it's not visible from anywhere!
+            if not self.is_inside(self.mic_array.R[:, m]):
+                visibility[m, :] = 0
+
+        return visibility
+
+    def _can_reuse_image_sources(self):
+        """
+        True if the image sources of all the sources were kept by the last
+        run of the image source model and do not depend on the microphones
+        """
+        # with max_distance, the image sources of polygonal rooms depend on
+        # the microphones and are searched again
+        return (
+            self.simulator_state["ism_done"]
+            and self.ism_args["keep_tree"]
+            and (isinstance(self, ShoeBox) or self.ism_args["max_distance"] <= 0)
+            and len(self.visibility) == len(self.sources)
+            and all(
+                getattr(source, "_ism_tree", None) is not None
+                for source in self.sources
+            )
+        )
+
+    def move_microphones(self, R):
+        """
+        Replaces the locations of the microphones of the room. The number of
+        microphones may change, unless they have directivities.
+
+        When the image source model was run with ``keep_tree`` set (see
+        :py:meth:`set_image_source_options`), the image sources are not
+        searched again, only their visibility from the new microphones is
+        computed. Otherwise, the image source model is run again by the next
+        simulation.
+
+        Parameters
+        ----------
+        R: array_like, shape (dim, n_mics)
+            The new locations of the microphones, one per column
+        """
+
+        R = np.array(R, dtype=float)
+        if R.ndim == 1:
+            R = R[:, None]
+
+        if R.ndim != 2 or R.shape[0] != self.dim:
+            raise ValueError(
+                "The microphone locations should be an array of shape ({}, n_mics)".format(
+                    self.dim
+                )
+            )
+
+        if self.mic_array is None:
+            raise ValueError("There are no microphones in the room to move")
+
+        if self.mic_array.directivity is not None and R.shape[1] != self.mic_array.M:
+            raise ValueError(
+                "The number of microphones with directivities cannot change"
+            )
+
+        if R.shape[1] != self.mic_array.M:
+            self.mic_array.signals = None
+        self.mic_array.R = R
+        self.mic_array.nmic = R.shape[1]
+        self.mic_array.center = np.mean(R, axis=1, keepdims=True)
+
+        self.room_engine.set_mics(R)
+
+        self.simulator_state["rt_done"] = False
+        self.simulator_state["rir_done"] = False
+
+        if self._can_reuse_image_sources():
+            self.visibility = []
+            for source in self.sources:
+                n_sources = self.room_engine.image_source_visibility(source._ism_tree)
+                visibility = self._set_image_sources(source, n_sources)
+                if visibility is not None:
+                    self.visibility.append(visibility)
+        else:
+            self.simulator_state["ism_done"] = False
+
+    def move_source(self, index, position):
+        """
+        Moves a source of the room.
+
+        When the image source model was run with ``keep_tree`` set (see
+        :py:meth:`set_image_source_options`), the image sources of a polygonal
+        room are found by applying the reflections of the kept image sources
+        to the new location, and only their visibility is computed again. This
+        is possible as long as the source stays closer to its location at the
+        last run than the smallest distance of an image source to a wall
+        tested by the search, otherwise the image source model is run again
+        by the next simulation.
+
+        Parameters
+        ----------
+        index: int
+            The index of the source in ``room.sources``
+        position: array_like
+            The new location of the source
+        """
+
+        position = np.array(position, dtype=float)
+
+        if position.shape != (self.dim,):
+            raise ValueError(
+                "The location of the source should have {} coordinates".format(
+                    self.dim
+                )
+            )
+
+        if not self.is_inside(position):
+            raise ValueError("The source must be inside the room.")
+
+        source = self.sources[index]
+        source.position = position
+
+        self.simulator_state["rt_done"] = False
+        self.simulator_state["rir_done"] = False
+
+        if self._can_reuse_image_sources() and self.room_engine.move_image_source_tree(
+            source._ism_tree, position
+        ):
+            n_sources = self.room_engine.image_source_visibility(source._ism_tree)
+            visibility = self._set_image_sources(source, n_sources)
+            if visibility is not None:
+                self.visibility[index] = visibility
+                return
+
+        self.simulator_state["ism_done"] = False
 
     def ray_tracing(self):
 
         if not self.simulator_state["rt_needed"]:
             return
 
-        # this will be a list of lists with
-        # shape (n_mics, n_src, n_directions, n_bands, n_time_bins)
-        self.rt_histograms = [[] for r in range(self.mic_array.M)]
+        source_locs = np.array(
+            [src.position for src in self.sources], dtype=np.float32
+        ).reshape(-1, self.dim).T
 
-        for s, src in enumerate(self.sources):
-            self.room_engine.ray_tracing(self.rt_args["n_rays"], src.position)
+        # all the histograms in an array of shape (n_src, n_mics, n_bands, n_time_bins)
+        if self.rt_args["reciprocal"]:
+            # trace from the microphones and collect the energy at the sources
+            hists = self.room_engine.ray_tracing_reciprocal(
+                self.rt_args["n_rays"], source_locs
+            )
+        else:
+            hists = self.room_engine.ray_tracing_sources(
+                self.rt_args["n_rays"], source_locs
+            )
 
-            for r in range(self.mic_array.M):
-                self.rt_histograms[r].append([])
-                for h in self.room_engine.microphones[r].histograms:
-                    # get a copy of the histogram
-                    self.rt_histograms[r][s].append(h.get_hist())
-            # reset all the receivers' histograms
-            self.room_engine.reset_mics()
+        # this will be a list of lists with
+        # shape (n_mics, n_src, n_directions, n_bands, n_time_bins)
+        # the histograms are views of the array returned by the engine
+        self.rt_histograms = [
+            [[hists[s, r]] for s in range(len(self.sources))]
+            for r in range(self.mic_array.M)
+        ]
 
         # update the state
         self.simulator_state["rt_done"] = True
 
-    def compute_rir(self):
+    def _diffuse_tails(self, lengths, bws, is_multi_band):
         """
-        Compute the room impulse response between every source and microphone.
+        Synthesizes the diffuse tails of the impulse responses of all the
+        pairs of microphones and sources from the histograms of the ray
+        tracing. The random sequences, the band filtering and the scaling by
+        the histograms are done by the engine, on the ray tracing threads.
+
+        Parameters
+        ----------
+        lengths: ndarray (n_mics, n_sources)
+            The number of samples of every tail, a multiple of the size of the
+            histogram bins
+        bws: array_like
+            The bandwidths of the bands
+        is_multi_band: bool
+            Whether the tail is filtered in the octave bands
+
+        Returns
+        -------
+        list of lists of ndarray
+            ``tails[m][s]`` is an array of shape ``(n_bands, lengths[m, s])``
         """
+        n_sources = len(self.sources)
 
-        if self.simulator_state["ism_needed"] and not self.simulator_state["ism_done"]:
-            self.image_source_model()
+        if is_multi_band:
+            filters = self.octave_bands.filters.T
+        else:
+            filters = np.zeros((0, 0))
+
+        # The bands should normally sum up to fs / 2
+        gains = np.sqrt(np.array(bws) / self.fs * 2.0)
+
+        # the random sequences follow the numpy random generator
+        seed = np.random.randint(np.iinfo(np.int32).max)
+
+        flat_tails = libroom.build_diffuse_tails(
+            [
+                self.rt_histograms[m][s][0]
+                for m in range(self.mic_array.M)
+                for s in range(n_sources)
+            ],
+            lengths.ravel().tolist(),
+            filters,
+            gains,
+            int(self.rt_args["hist_bin_size_samples"]),
+            self.get_volume(),
+            self.c,
+            self.fs,
+            seed,
+            n_threads=self.rt_args["n_threads"],
+        )
 
-        if self.simulator_state["rt_needed"] and not self.simulator_state["rt_done"]:
-            self.ray_tracing()
+        return [
+            flat_tails[m * n_sources : (m + 1) * n_sources]
+            for m in range(self.mic_array.M)
+        ]
 
-        self.rir = []
+    def _image_source_rirs(self, use_fused_rir):
+        """
+        Computes the image source part of the impulse responses of all the
+        pairs of microphones and sources, band by band.
+
+        Returns
+        -------
+        rirs: list of lists of ndarray
+            ``rirs[m][s]`` is an array of shape ``(n_bands, N + fdl)`` where
+            ``N`` is the delay of the farthest image source in samples
+        t_max: list of lists of float
+            ``t_max[m][s]`` is the delay of the farthest image source in
+            seconds
+        """
+
+        fdl = constants.get("frac_delay_length")
+        n_mics = self.mic_array.M
+
+        if use_fused_rir:
+            # the engine walks the images without storing them
+            rirs = [[] for m in range(n_mics)]
+            for src in self.sources:
+                src_rirs = self.room_engine.shoebox_rir(
+                    src.position, self.fs, self.c, fdl
+                )
+                for m in range(n_mics):
+                    # microphones outside of the room do not see the image sources
+                    if not self.is_inside(self.mic_array.R[:, m]):
+                        src_rirs[m][:] = 0.0
+                    rirs[m].append(src_rirs[m])
+
+            t_max = [[(r.shape[1] - fdl) / self.fs for r in row] for row in rirs]
+            return rirs, t_max
 
-        volume_room = self.get_volume()
+        # The delays and amplitudes of the image sources of all the pairs
+        # are collected first, and the responses built in one call
+        is_multi_band = self.is_multi_band
+        bws = self.octave_bands.get_bw() if is_multi_band else [self.fs / 2]
+        times, alphas, visibilities, lengths, t_max = [], [], [], [], []
 
         for m, mic in enumerate(self.mic_array.R.T):
-            self.rir.append([])
+            t_max.append([])
             for s, src in enumerate(self.sources):
 
-                """
-                Compute the room impulse response between the source
-                and the microphone whose position is given as an
-                argument.
-                """
-                # fractional delay length
-                fdl = constants.get("frac_delay_length")
-                fdl2 = fdl // 2
+                # compute azimuth and colatitude angles for receiver
+                if self.mic_array.directivity is not None:
+                    angle_function_array = angle_function(src.images, mic)
+                    azimuth = angle_function_array[0]
+                    colatitude = angle_function_array[1]
+
+                # compute azimuth and colatitude angles for source
+                if self.sources[s].directivity is not None:
+                    azimuth_s, colatitude_s = source_angle_shoebox(
+                        image_source_loc=src.images,
+                        wall_flips=abs(src.orders_xyz),
+                        mic_loc=mic,
+                    )
 
-                # default, just in case both ism and rt are disabled (should never happen)
-                N = fdl
+                # compute the distance from image sources
+                dist = np.sqrt(np.sum((src.images - mic[:, None]) ** 2, axis=0))
+                time = dist / self.c
+                t_max[-1].append(time.max())
+                N = int(math.ceil(t_max[-1][-1] * self.fs))
 
-                if self.simulator_state["ism_needed"]:
+                alpha = np.zeros((len(bws), dist.shape[0]))
+                for b, bw in enumerate(bws):
+
+                    alpha[b] = src.damping[b, :] / dist
 
-                    # compute azimuth and colatitude angles for receiver
                     if self.mic_array.directivity is not None:
-                        angle_function_array = angle_function(src.images, mic)
-                        azimuth = angle_function_array[0]
-                        colatitude = angle_function_array[1]
 
-                    # compute azimuth and colatitude angles for source
+                        alpha[b] *= self.mic_array.directivity[m].get_response(
+                            azimuth=azimuth,
+                            colatitude=colatitude,
+                            frequency=bw,
+                            degrees=False,
+                        )
+
                     if self.sources[s].directivity is not None:
-                        azimuth_s, colatitude_s = source_angle_shoebox(
-                            image_source_loc=src.images,
-                            wall_flips=abs(src.orders_xyz),
-                            mic_loc=mic,
+                        alpha[b] *= self.sources[s].directivity.get_response(
+                            azimuth=azimuth_s,
+                            colatitude=colatitude_s,
+                            frequency=bw,
+                            degrees=False,
                         )
 
-                    # compute the distance from image sources
-                    dist = np.sqrt(np.sum((src.images - mic[:, None]) ** 2, axis=0))
-                    time = dist / self.c
-                    t_max = time.max()
-                    N = int(math.ceil(t_max * self.fs))
+                times.append(time)
+                alphas.append(alpha)
+                visibilities.append(self.visibility[s][m, :].astype(np.int32))
+                lengths.append(N + fdl)
+
+        # the filters are delayed by fdl // 2 samples to avoid problems when
+        # the propagation is shorter than the delay of the filter
+        flat_rirs = libroom.build_rirs(
+            times,
+            alphas,
+            visibilities,
+            lengths,
+            self.fs,
+            fdl,
+            n_threads=self.ism_args["n_threads"],
+        )
+
+        n_src = len(self.sources)
+        rirs = [flat_rirs[m * n_src : (m + 1) * n_src] for m in range(n_mics)]
+
+        return rirs, t_max
+
+    def compute_rir(self):
+        """
+        Compute the room impulse response between every source and microphone.
+        """
+
+        # In shoebox rooms, the engine can build the image source part of the
+        # impulse responses directly, without storing the image sources
+        use_fused_rir = (
+            self.simulator_state["ism_needed"]
+            and self.ism_args["fused_rir"]
+            and isinstance(self, ShoeBox)
+            and not self.simulator_state["random_ism_needed"]
+            and self.mic_array.directivity is None
+            and all([src.directivity is None for src in self.sources])
+        )
+
+        if (
+            self.simulator_state["ism_needed"]
+            and not self.simulator_state["ism_done"]
+            and not use_fused_rir
+        ):
+            self.image_source_model()
+
+        if self.simulator_state["rt_needed"] and not self.simulator_state["rt_done"]:
+            self.ray_tracing()
+
+        self.rir = []
+
+        # fractional delay length
+        fdl = constants.get("frac_delay_length")
+        fdl2 = fdl // 2
+
+        if self.simulator_state["ism_needed"]:
+            ism_rirs, ism_t_max = self._image_source_rirs(use_fused_rir)
+
+        # the number of samples of every response, without the fractional
+        # delay filter
+        lengths = np.full((self.mic_array.M, len(self.sources)), fdl, dtype=int)
+
+        for m in range(self.mic_array.M):
+            for s in range(len(self.sources)):
+
+                if self.simulator_state["ism_needed"]:
+                    t_max = ism_t_max[m][s]
+                    lengths[m, s] = ism_rirs[m][s].shape[1] - fdl
 
                 else:
                     t_max = 0.0
@@ -2239,9 +2849,26 @@ class Room(object):
 
                     # the number of samples needed
                     # round up to multiple of the histogram bin size
-                    # add the lengths of the fractional delay filter
                     hbss = int(self.rt_args["hist_bin_size_samples"])
-                    N = int(math.ceil(t_max * self.fs / hbss) * hbss)
+                    lengths[m, s] = int(math.ceil(t_max * self.fs / hbss) * hbss)
+
+        # Do band-wise RIR construction
+        is_multi_band = self.is_multi_band
+        bws = self.octave_bands.get_bw() if is_multi_band else [self.fs / 2]
+
+        if self.simulator_state["rt_needed"]:
+            tails = self._diffuse_tails(lengths, bws, is_multi_band)
+
+        for m, mic in enumerate(self.mic_array.R.T):
+            self.rir.append([])
+            for s, src in enumerate(self.sources):
+
+                """
+                Compute the room impulse response between the source
+                and the microphone whose position is given as an
+                argument.
+                """
+                N = lengths[m, s]
 
                 # this is where we will compose the RIR
                 ir = np.zeros(N + fdl)
@@ -2249,13 +2876,6 @@ class Room(object):
                 # This is the distance travelled wrt time
                 distance_rir = np.arange(N) / self.fs * self.c
 
-                # this is the random sequence for the tail generation
-                seq = sequence_generation(volume_room, N / self.fs, self.c, self.fs)
-                seq = seq[:N]
-
-                # Do band-wise RIR construction
-                is_multi_band = self.is_multi_band
-                bws = self.octave_bands.get_bw() if is_multi_band else [self.fs / 2]
                 rir_bands = []
 
                 for b, bw in enumerate(bws):
@@ -2265,35 +2885,8 @@ class Room(object):
                     # IS method
                     if self.simulator_state["ism_needed"]:
 
-                        alpha = src.damping[b, :] / dist
-
-                        if self.mic_array.directivity is not None:
-
-                            alpha *= self.mic_array.directivity[m].get_response(
-                                azimuth=azimuth,
-                                colatitude=colatitude,
-                                frequency=bw,
-                                degrees=False,
-                            )
-
-                        if self.sources[s].directivity is not None:
-                            alpha *= self.sources[s].directivity.get_response(
-                                azimuth=azimuth_s,
-                                colatitude=colatitude_s,
-                                frequency=bw,
-                                degrees=False,
-                            )
-
-                        # Use the Cython extension for the fractional delays
-                        from .build_rir import fast_rir_builder
-
-                        vis = self.visibility[s][m, :].astype(np.int32)
-                        # we add the delay due to the factional delay filter to
-                        # the arrival times to avoid problems when propagation
-                        # is shorter than the delay to to the filter
-                        # hence: time + fdl2
-                        time_adjust = time + fdl2 / self.fs
-                        fast_rir_builder(ir_loc, time_adjust, alpha, vis, self.fs, fdl)
+                        ism_rir = ism_rirs[m][s][b]
+                        ir_loc[: ism_rir.shape[0]] = ism_rir
 
                         if is_multi_band:
                             ir_loc = self.octave_bands.analysis(ir_loc, band=b)
@@ -2302,28 +2895,7 @@ class Room(object):
 
                     # Ray Tracing
                     if self.simulator_state["rt_needed"]:
-
-                        if is_multi_band:
-                            seq_bp = self.octave_bands.analysis(seq, band=b)
-                        else:
-                            seq_bp = seq.copy()
-
-                        # interpolate the histogram and multiply the sequence
-                        seq_bp_rot = seq_bp.reshape((-1, hbss))
-                        new_n_bins = seq_bp_rot.shape[0]
-
-                        hist = self.rt_histograms[m][s][0][b, :new_n_bins]
-
-                        normalization = np.linalg.norm(seq_bp_rot, axis=1)
-                        indices = normalization > 0.0
-                        seq_bp_rot[indices, :] /= normalization[indices, None]
-                        seq_bp_rot *= np.sqrt(hist[:, None])
-
-                        # Normalize the band power
-                        # The bands should normally sum up to fs / 2
-                        seq_bp *= np.sqrt(bw / self.fs * 2.0)
-
-                        ir_loc[fdl2 : fdl2 + N] += seq_bp
+                        ir_loc[fdl2 : fdl2 + N] += tails[m][s][b]
 
                     # keep for further processing
                     rir_bands.append(ir_loc)
@@ -3133,3 +3705,167 @@ class AnechoicRoom(ShoeBox):
         if "img_order" in kwargs.keys():
             warnings.warn("Ignoring img_order argument for AnechoicRoom.", UserWarning)
         ShoeBox.plot(self, **kwargs)
+
+
+def simulate_shoebox_batch(
+    room_dims,
+    absorption,
+    sources,
+    mics,
+    fs,
+    max_order,
+    length,
+    scattering=None,
+    ray_tracing=False,
+    air_absorption=False,
+    n_rays=10000,
+    receiver_radius=0.5,
+    energy_thres=1e-7,
+    time_thres=10.0,
+    hist_bin_size=0.004,
+    c=None,
+    n_threads=0,
+    out=None,
+):
+    """
+    Computes the impulse responses of many shoebox rooms at once. The rooms
+    are simulated in parallel by the engine, without creating
+    :py:class:`ShoeBox` objects or storing the image sources. The steps are
+    the ones of :py:meth:`Room.compute_rir`: the image source model, the
+    ray tracing and the diffuse tails, and the air absorption.
+
+    Parameters
+    ----------
+    room_dims: array_like, shape (n_rooms, dim)
+        The sizes of the rooms
+    absorption: array_like, shape (n_rooms, 2 * dim) or (n_rooms, n_bands, 2 * dim)
+        The energy absorption of the walls of every room, in the order west,
+        east, south, north, floor, ceiling. With several bands, they are the
+        octave bands of :py:class:`~pyroomacoustics.acoustics.OctaveBandsFactory`
+    sources: array_like, shape (n_rooms, dim)
+        The location of the source of every room
+    mics: array_like, shape (n_rooms, dim, n_mics)
+        The locations of the microphones of every room
+    fs: int
+        The sampling frequency
+    max_order: int
+        The maximum order of the image sources
+    length: int
+        The number of samples of the impulse responses. The image sources
+        whose fractional delay filter does not fit, and the end of the
+        diffuse tails, are left out
+    scattering: array_like, optional
+        The scattering of the walls of every room, with the same shape as
+        ``absorption`` (default: no scattering)
+    ray_tracing: bool, optional
+        Adds the diffuse tails obtained by ray tracing (default: False)
+    air_absorption: bool, optional
+        Applies the air absorption of the octave bands (default: False)
+    n_rays: int, optional
+        The number of rays traced in every room (default: 10000)
+    receiver_radius: float, optional
+        The radius of the receivers of the ray tracing (default: 0.5 m)
+    energy_thres: float, optional
+        The energy below which the rays are stopped (default: 1e-7)
+    time_thres: float, optional
+        The time after which the rays are stopped (default: 10 s)
+    hist_bin_size: float, optional
+        The size of the bins of the histograms, rounded down to a whole
+        number of samples (default: 0.004 s)
+    c: float, optional
+        The speed of sound (default: ``pra.constants.get("c")``)
+    n_threads: int, optional
+        The number of threads, 0 means all the cores (default: 0)
+    out: ndarray, shape (n_rooms, n_mics, length), optional
+        A C-contiguous array of ``float64`` where the responses are written,
+        to reuse the memory between batches
+
+    Returns
+    -------
+    ndarray, shape (n_rooms, n_mics, length)
+        The impulse responses, ``out`` when it is given
+    """
+
+    if c is None:
+        c = constants.get("c")
+
+    room_dims = np.array(room_dims, dtype=np.float32)
+    sources = np.array(sources, dtype=np.float32)
+    mics = np.array(mics, dtype=np.float32)
+    n_rooms, dim = room_dims.shape
+    n_mics = mics.shape[2]
+
+    absorption = np.array(absorption, dtype=np.float32)
+    if absorption.ndim == 2:
+        absorption = absorption[:, None, :]
+    n_bands = absorption.shape[1]
+
+    if scattering is None:
+        scattering = np.zeros_like(absorption)
+    else:
+        scattering = np.array(scattering, dtype=np.float32).reshape(absorption.shape)
+
+    if out is None:
+        out = np.zeros((n_rooms, n_mics, length))
+    elif (
+        out.shape != (n_rooms, n_mics, length)
+        or out.dtype != np.float64
+        or not out.flags.c_contiguous
+    ):
+        raise ValueError(
+            "The output array should be a C-contiguous float64 array of shape {}".format(
+                (n_rooms, n_mics, length)
+            )
+        )
+
+    octave_bands = OctaveBandsFactory(fs=fs)
+    if n_bands > 1 and n_bands != octave_bands.n_bands:
+        raise ValueError(
+            "The absorption should be given for {} octave bands".format(
+                octave_bands.n_bands
+            )
+        )
+
+    # The bands should normally sum up to fs / 2
+    bws = octave_bands.get_bw() if n_bands > 1 else [fs / 2]
+    gains = np.sqrt(np.array(bws) / fs * 2.0)
+
+    # a single band is only split in octave bands for the air absorption
+    if n_bands > 1 or air_absorption:
+        filters = octave_bands.filters.T
+    else:
+        filters = np.zeros((0, 0))
+
+    if air_absorption:
+        air_coeffs = octave_bands(**Physics().from_speed(c).get_air_absorption())
+    else:
+        air_coeffs = np.zeros(0)
+
+    # the random sequences of the tails follow the numpy random generator
+    seed = np.random.randint(np.iinfo(np.int32).max)
+
+    batch = libroom.shoebox_rir_batch if dim == 3 else libroom.shoebox_rir_batch2D
+    batch(
+        room_dims,
+        absorption.reshape(n_rooms, -1),
+        scattering.reshape(n_rooms, -1),
+        sources,
+        mics.reshape(n_rooms, -1),
+        max_order,
+        fs,
+        c,
+        constants.get("frac_delay_length"),
+        filters,
+        gains,
+        np.array(air_coeffs, dtype=np.float64),
+        n_rays if ray_tracing else 0,
+        energy_thres,
+        time_thres,
+        receiver_radius,
+        math.floor(fs * hist_bin_size),
+        seed,
+        n_threads=n_threads,
+        out=out.reshape(n_rooms, -1),
+    )
+
+    return out
@@ -101,6 +101,13 @@ class SoundSource(object):
         if directivity is not None:
             self.set_directivity(directivity)
 
+    def __getstate__(self):
+        # The image sources kept by the engine are not pickled, they are
+        # searched again by the next run of the image source model
+        state = self.__dict__.copy()
+        state.pop("_ism_tree", None)
+        return state
+
     def set_directivity(self, directivity):
         """
         Sets self.directivity as a list of directivities with 1 entry
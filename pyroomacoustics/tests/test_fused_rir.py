@@ -0,0 +1,49 @@
+"""
+The engine can build the image source part of the impulse responses of shoebox
+rooms directly. This test checks that the impulse responses are the same as the
+ones built from the image sources.
+"""
+import numpy as np
+import pyroomacoustics as pra
+
+room_dim = [6.0, 5.0, 3.0]
+source = [5.0, 1.5, 1.5]
+mics = np.array([[1.0, 4.0, 1.2], [3.0, 2.5, 1.7]]).T
+
+
+def compute_rir(fused_rir, materials, max_distance=None):
+    room = pra.ShoeBox(
+        room_dim, fs=16000, materials=materials, max_order=12, air_absorption=True
+    )
+    room.set_image_source_options(max_distance=max_distance, fused_rir=fused_rir)
+    room.add_source(source)
+    room.add_microphone_array(mics)
+    room.compute_rir()
+    return room.rir
+
+
+def check_rir(**kwargs):
+    rir = compute_rir(False, **kwargs)
+    rir_fused = compute_rir(True, **kwargs)
+
+    for m in range(mics.shape[1]):
+        assert rir_fused[m][0].shape == rir[m][0].shape
+        assert np.allclose(rir_fused[m][0], rir[m][0], atol=1e-4)
+
+
+def test_fused_rir_single_band():
+    check_rir(materials=pra.Material(energy_absorption=0.2))
+
+
+def test_fused_rir_multi_band():
+    check_rir(materials=pra.Material("brickwork"))
+
+
+def test_fused_rir_max_distance():
+    check_rir(materials=pra.Material(energy_absorption=0.2), max_distance=30.0)
+
+
+if __name__ == "__main__":
+    test_fused_rir_single_band()
+    test_fused_rir_multi_band()
+    test_fused_rir_max_distance()
@@ -0,0 +1,94 @@
+"""
+When the image sources are kept between runs, moving the microphones only
+recomputes their visibility. This test checks that the image sources are the
+same as the ones found by a new room with the microphones at the new locations.
+"""
+import numpy as np
+import pyroomacoustics as pra
+
+corners = np.array([[0.0, 0.0], [6.0, 0.0], [6.0, 2.0], [2.0, 2.0], [2.0, 5.0], [0.0, 5.0]]).T
+source = [5.0, 1.5, 1.5]
+mics = np.array([[1.0, 4.0, 1.2], [5.0, 1.0, 1.2]]).T
+new_mics = np.array([[1.5, 1.0, 2.0], [0.5, 3.0, 1.0], [4.0, 1.5, 0.8]]).T
+
+
+def make_room(dim, **ism_options):
+    room = pra.Room.from_corners(
+        corners, fs=16000, materials=pra.Material(energy_absorption=0.2), max_order=4
+    )
+    if dim == 3:
+        room.extrude(3.0, materials=pra.Material(energy_absorption=0.2))
+    room.set_image_source_options(**ism_options)
+    room.add_source(source[:dim])
+    return room
+
+
+def make_shoebox(dim):
+    room = pra.ShoeBox(
+        [6.0, 5.0, 3.0][:dim],
+        fs=16000,
+        materials=pra.Material(energy_absorption=0.2),
+        max_order=6,
+    )
+    room.set_image_source_options(keep_tree=True)
+    room.add_source(source[:dim])
+    return room
+
+
+def check_same(room, ref):
+    for src, src_ref in zip(room.sources, ref.sources):
+        assert np.array_equal(src.images, src_ref.images)
+        assert np.array_equal(src.damping, src_ref.damping)
+        assert np.array_equal(src.orders, src_ref.orders)
+    for vis, vis_ref in zip(room.visibility, ref.visibility):
+        assert np.array_equal(vis, vis_ref)
+
+
+def check_move(room, ref):
+    room.add_microphone_array(mics[: room.dim])
+    room.image_source_model()
+
+    room.move_microphones(new_mics[: room.dim])
+    assert room.simulator_state["ism_done"]
+
+    ref.add_microphone_array(new_mics[: ref.dim])
+    ref.image_source_model()
+
+    check_same(room, ref)
+
+
+def test_move_microphones_2d():
+    for beam_pruning in [False, True]:
+        check_move(
+            make_room(2, keep_tree=True, beam_pruning=beam_pruning, n_threads=2),
+            make_room(2),
+        )
+
+
+def test_move_microphones_3d():
+    for beam_pruning in [False, True]:
+        check_move(
+            make_room(3, keep_tree=True, beam_pruning=beam_pruning, n_threads=2),
+            make_room(3),
+        )
+
+
+def test_move_microphones_shoebox():
+    for dim in [2, 3]:
+        check_move(make_shoebox(dim), make_shoebox(dim))
+
+
+def test_move_microphones_without_tree():
+    room = make_room(3)
+    room.add_microphone_array(mics)
+    room.image_source_model()
+
+    room.move_microphones(new_mics)
+    assert not room.simulator_state["ism_done"]
+
+
+if __name__ == "__main__":
+    test_move_microphones_2d()
+    test_move_microphones_3d()
+    test_move_microphones_shoebox()
+    test_move_microphones_without_tree()
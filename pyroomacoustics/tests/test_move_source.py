@@ -0,0 +1,59 @@
+"""
+When the image sources are kept between runs, the image sources of a source
+that moves a little are found by reflecting its new location across the walls
+of the kept image sources. This test checks that they are the same as the ones
+found by a new room with the source at the new location.
+"""
+import numpy as np
+import pyroomacoustics as pra
+
+corners = np.array([[0.0, 0.0], [6.0, 0.0], [6.0, 2.0], [2.0, 2.0], [2.0, 5.0], [0.0, 5.0]]).T
+source = np.array([5.0, 1.5, 1.5])
+moved = np.array([4.95, 1.52, 1.48])
+far = np.array([1.0, 4.0, 1.5])
+mics = np.array([[1.0, 4.0, 1.2], [5.0, 1.0, 1.2], [1.5, 1.0, 2.0]]).T
+
+
+def make_room(dim, position, keep_tree):
+    room = pra.Room.from_corners(
+        corners, fs=16000, materials=pra.Material(energy_absorption=0.2), max_order=4
+    )
+    if dim == 3:
+        room.extrude(3.0, materials=pra.Material(energy_absorption=0.2))
+    room.set_image_source_options(keep_tree=keep_tree, n_threads=2)
+    room.add_source(position[:dim])
+    room.add_microphone_array(mics[:dim])
+    room.image_source_model()
+    return room
+
+
+def check_move(dim):
+    room = make_room(dim, source, True)
+    room.move_source(0, moved[:dim])
+    assert room.simulator_state["ism_done"]
+
+    ref = make_room(dim, moved, False)
+
+    src, src_ref = room.sources[0], ref.sources[0]
+    assert np.allclose(src.images, src_ref.images, atol=1e-4)
+    assert np.array_equal(src.damping, src_ref.damping)
+    assert np.array_equal(src.orders, src_ref.orders)
+    assert np.array_equal(src.walls, src_ref.walls)
+    assert np.array_equal(room.visibility[0], ref.visibility[0])
+
+    # too far for the kept image sources, they are searched again
+    room.move_source(0, far[:dim])
+    assert not room.simulator_state["ism_done"]
+
+
+def test_move_source_2d():
+    check_move(2)
+
+
+def test_move_source_3d():
+    check_move(3)
+
+
+if __name__ == "__main__":
+    test_move_source_2d()
+    test_move_source_3d()
@@ -0,0 +1,99 @@
+"""
+A room can be created from arrays of vertices and faces, the walls are then
+built by the engine. This test checks that the simulation is the same as the
+one of a room created from the corresponding list of walls.
+"""
+import numpy as np
+import pyroomacoustics as pra
+
+corners = np.array([[0.0, 0.0], [6.0, 0.0], [6.0, 2.0], [2.0, 2.0], [2.0, 5.0], [0.0, 5.0]]).T
+source = np.array([5.0, 1.5, 1.5])
+mics = np.array([[1.0, 4.0, 1.2], [5.0, 1.0, 1.2]]).T
+
+
+def make_reference(dim):
+    material = pra.Material(energy_absorption="hard_surface", scattering=0.1)
+    room = pra.Room.from_corners(corners, fs=16000, materials=material, max_order=4)
+    if dim == 3:
+        room.extrude(3.0, materials=material)
+    room.add_source(source[:dim])
+    room.add_microphone_array(mics[:dim])
+    return room
+
+
+def mesh_of(walls):
+    # the corners of all the walls one after the other, padded faces
+    n_corners = [w.corners.shape[1] for w in walls]
+    vertices = np.concatenate([w.corners for w in walls], axis=1)
+    faces = -np.ones((len(walls), max(n_corners)), dtype=np.int32)
+    start = 0
+    for f, n in enumerate(n_corners):
+        faces[f, :n] = np.arange(start, start + n)
+        start += n
+    return vertices, faces
+
+
+def check_mesh(dim):
+    ref = make_reference(dim)
+    vertices, faces = mesh_of(ref.walls)
+
+    room = pra.Room.from_mesh(
+        vertices,
+        faces,
+        absorption=np.array([w.absorption for w in ref.walls]).T,
+        scattering=np.array([w.scatter for w in ref.walls]).T,
+        fs=16000,
+        max_order=4,
+    )
+    room.add_source(source[:dim])
+    room.add_microphone_array(mics[:dim])
+
+    assert room.dim == dim
+    assert len(room.walls) == len(ref.walls)
+    assert sorted(room.room_engine.obstructing_walls) == sorted(
+        ref.room_engine.obstructing_walls
+    )
+    for wall, wall_ref in zip(room.walls, ref.walls):
+        assert np.allclose(wall.normal, wall_ref.normal, atol=1e-5)
+        assert np.allclose(wall.absorption, wall_ref.absorption)
+
+    room.compute_rir()
+    ref.compute_rir()
+
+    assert np.allclose(room.sources[0].images, ref.sources[0].images, atol=1e-5)
+    assert np.array_equal(room.visibility[0], ref.visibility[0])
+    for m in range(mics.shape[1]):
+        assert np.allclose(room.rir[m][0], ref.rir[m][0], atol=1e-6)
+
+
+def test_room_from_mesh_2d():
+    check_mesh(2)
+
+
+def test_room_from_mesh_3d():
+    check_mesh(3)
+
+
+def test_room_from_mesh_materials():
+    ref = make_reference(3)
+    vertices, faces = mesh_of(ref.walls)
+
+    material = pra.Material(energy_absorption="hard_surface", scattering=0.1)
+    room = pra.Room.from_mesh(vertices, faces, materials=material, fs=16000)
+    for wall, wall_ref in zip(room.walls, ref.walls):
+        assert np.allclose(wall.absorption, wall_ref.absorption)
+        assert np.allclose(wall.scatter, wall_ref.scatter)
+
+    faces[0, 0] = vertices.shape[1]
+    try:
+        pra.Room.from_mesh(vertices, faces, materials=material, fs=16000)
+    except RuntimeError:
+        pass
+    else:
+        assert False, "a face refers to a vertex that does not exist"
+
+
+if __name__ == "__main__":
+    test_room_from_mesh_2d()
+    test_room_from_mesh_3d()
+    test_room_from_mesh_materials()
@@ -0,0 +1,157 @@
+"""
+Many shoebox rooms can be simulated at once by the engine. This test checks
+that the impulse responses are the same as the ones of ShoeBox rooms, with
+the image sources only, and with the ray tracing and the air absorption when
+the random generator is seeded the same way.
+"""
+import numpy as np
+import pyroomacoustics as pra
+
+fs = 16000
+max_order = 6
+length = 4000
+n_rays = 2000
+seed = 7
+
+room_dims = np.array([[5.0, 4.0, 3.0], [7.5, 3.5, 2.75], [3.0, 6.0, 4.0]])
+absorption = np.array(
+    [
+        [0.1, 0.2, 0.3, 0.4, 0.5, 0.6],
+        [0.3, 0.3, 0.3, 0.3, 0.3, 0.3],
+        [0.5, 0.1, 0.05, 0.2, 0.4, 0.25],
+    ]
+)
+scattering = np.array(
+    [
+        [0.1, 0.1, 0.1, 0.1, 0.1, 0.1],
+        [0.0, 0.2, 0.4, 0.2, 0.0, 0.1],
+        [0.3, 0.3, 0.3, 0.3, 0.3, 0.3],
+    ]
+)
+sources = np.array([[1.0, 1.5, 1.2], [6.0, 2.0, 1.0], [1.5, 4.5, 3.0]])
+mics = np.array(
+    [
+        [[2.0, 4.0], [3.0, 1.0], [1.5, 1.6]],
+        [[1.0, 3.0], [1.0, 2.5], [1.7, 1.2]],
+        [[2.5, 0.5], [0.5, 5.5], [1.0, 2.0]],
+    ]
+)
+
+
+def reference(dim, r, hybrid=False):
+    room = pra.ShoeBox(
+        room_dims[r, :dim],
+        fs=fs,
+        materials={
+            name: pra.Material(energy_absorption=a, scattering=s)
+            for name, a, s in zip(
+                ["west", "east", "south", "north", "floor", "ceiling"],
+                absorption[r, : 2 * dim],
+                scattering[r, : 2 * dim],
+            )
+        },
+        max_order=max_order,
+        ray_tracing=hybrid,
+        air_absorption=hybrid,
+    )
+    if hybrid:
+        room.set_ray_tracing(n_rays=n_rays)
+    room.add_source(sources[r, :dim])
+    room.add_microphone_array(mics[r, :dim])
+
+    np.random.seed(seed)
+    room.compute_rir()
+
+    rirs = np.zeros((mics.shape[2], length))
+    for m in range(mics.shape[2]):
+        n = min(length, len(room.rir[m][0]))
+        rirs[m, :n] = room.rir[m][0][:n]
+    return rirs
+
+
+def check_batch(dim):
+    out = np.zeros((len(room_dims), mics.shape[2], length))
+    rirs = pra.simulate_shoebox_batch(
+        room_dims[:, :dim],
+        absorption[:, : 2 * dim],
+        sources[:, :dim],
+        mics[:, :dim],
+        fs,
+        max_order,
+        length,
+        n_threads=2,
+        out=out,
+    )
+
+    assert rirs is out
+
+    for r in range(len(room_dims)):
+        # the responses are the same where all the images fit
+        assert np.allclose(rirs[r, :, : length - 100], reference(dim, r)[:, : length - 100])
+
+
+def check_batch_hybrid(dim):
+    for r in range(len(room_dims)):
+        # the tails of the first room of a batch use the seed as is
+        np.random.seed(seed)
+        rirs = pra.simulate_shoebox_batch(
+            room_dims[r : r + 1, :dim],
+            absorption[r : r + 1, : 2 * dim],
+            sources[r : r + 1, :dim],
+            mics[r : r + 1, :dim],
+            fs,
+            max_order,
+            length,
+            scattering=scattering[r : r + 1, : 2 * dim],
+            ray_tracing=True,
+            air_absorption=True,
+            n_rays=n_rays,
+        )
+
+        # the band filters of the end of the responses see different samples
+        assert np.allclose(rirs[0, :, : length - 600], reference(dim, r, True)[:, : length - 600])
+
+    # the rooms do not depend on the number of threads
+    rirs = []
+    for n_threads in [1, 2]:
+        np.random.seed(seed)
+        rirs.append(
+            pra.simulate_shoebox_batch(
+                room_dims[:, :dim],
+                absorption[:, : 2 * dim],
+                sources[:, :dim],
+                mics[:, :dim],
+                fs,
+                max_order,
+                length,
+                scattering=scattering[:, : 2 * dim],
+                ray_tracing=True,
+                air_absorption=True,
+                n_rays=n_rays,
+                n_threads=n_threads,
+            )
+        )
+    assert np.array_equal(rirs[0], rirs[1])
+
+
+def test_shoebox_batch_2d():
+    check_batch(2)
+
+
+def test_shoebox_batch_3d():
+    check_batch(3)
+
+
+def test_shoebox_batch_hybrid_2d():
+    check_batch_hybrid(2)
+
+
+def test_shoebox_batch_hybrid_3d():
+    check_batch_hybrid(3)
+
+
+if __name__ == "__main__":
+    test_shoebox_batch_2d()
+    test_shoebox_batch_3d()
+    test_shoebox_batch_hybrid_2d()
+    test_shoebox_batch_hybrid_3d()
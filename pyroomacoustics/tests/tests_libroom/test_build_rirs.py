@@ -0,0 +1,83 @@
+"""
+The impulse responses can be built from the image sources by the engine, for
+several responses at once. This test checks that they are the same as the ones
+of the Cython builder, and that out of range delays are caught.
+"""
+import numpy as np
+import pyroomacoustics as pra
+from pyroomacoustics import libroom
+
+try:
+    from pyroomacoustics import build_rir
+
+    build_rir_available = True
+except ImportError:
+    build_rir_available = False
+
+fs = 16000
+fdl = 81
+n_bands = 3
+n_images = [500, 1, 200]
+
+
+def make_inputs():
+    rng = np.random.RandomState(0)
+    times, alphas, visibilities, lengths = [], [], [], []
+    for n in n_images:
+        times.append(rng.uniform(0.001, 0.1, size=n))
+        alphas.append(rng.uniform(-1.0, 1.0, size=(n_bands, n)))
+        visibilities.append((rng.uniform(size=n) < 0.8).astype(np.int32))
+        lengths.append(int(np.ceil(times[-1].max() * fs)) + fdl)
+    return times, alphas, visibilities, lengths
+
+
+def test_build_rirs_cython():
+
+    if not build_rir_available:
+        return
+
+    times, alphas, visibilities, lengths = make_inputs()
+
+    for n_threads in [1, 2]:
+        rirs = libroom.build_rirs(
+            times, alphas, visibilities, lengths, fs, fdl, n_threads=n_threads
+        )
+
+        for r in range(len(n_images)):
+            assert rirs[r].shape == (n_bands, lengths[r])
+            for b in range(n_bands):
+                ir = np.zeros(lengths[r])
+                build_rir.fast_rir_builder(
+                    ir,
+                    times[r] + (fdl // 2) / fs,
+                    alphas[r][b].copy(),
+                    visibilities[r],
+                    fs,
+                    fdl,
+                )
+                assert np.allclose(rirs[r][b], ir, atol=1e-12)
+
+
+def test_build_rirs_errors():
+
+    times, alphas, visibilities, lengths = make_inputs()
+
+    # the last delay does not fit in the response
+    lengths[0] -= fdl
+    try:
+        libroom.build_rirs(times, alphas, visibilities, lengths, fs, fdl)
+        assert False
+    except RuntimeError:
+        pass
+
+    # the filter length should be odd
+    try:
+        libroom.build_rirs(times, alphas, visibilities, lengths, fs, 80)
+        assert False
+    except RuntimeError:
+        pass
+
+
+if __name__ == "__main__":
+    test_build_rirs_cython()
+    test_build_rirs_errors()
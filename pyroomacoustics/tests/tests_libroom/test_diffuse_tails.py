@@ -0,0 +1,117 @@
+"""
+The diffuse tails of the impulse responses are synthesized by the engine from
+the histograms of the ray tracing. This test checks that the energy of every
+bin of the tails is the one of the histograms, that the band filtering is the
+same as fftconvolve, and that the tails do not depend on the number of threads.
+"""
+import numpy as np
+import pyroomacoustics as pra
+from pyroomacoustics import libroom
+from scipy.signal import fftconvolve
+
+fs = 16000
+hbss = 64
+volume = 60.0
+c = 343.0
+
+
+def make_histograms(n_bands, n_pairs):
+    bins = np.arange(250)
+    return [
+        np.exp(-0.02 * (p + 1) * np.outer(np.arange(1, n_bands + 1), bins)).astype(
+            np.float32
+        )
+        * (bins > 3)
+        for p in range(n_pairs)
+    ]
+
+
+def test_diffuse_tails_energy():
+    octave_bands = pra.acoustics.OctaveBandsFactory(fs=fs)
+    n_bands = octave_bands.n_bands
+    gains = np.sqrt(octave_bands.get_bw() / fs * 2.0)
+
+    hists = make_histograms(n_bands, 3)
+    # the last one is longer than its histogram
+    lengths = [hbss * 200, hbss * 240, hbss * 300]
+
+    tails = libroom.build_diffuse_tails(
+        hists, lengths, octave_bands.filters.T, gains, hbss, volume, c, fs, 1234
+    )
+
+    for tail, hist, length in zip(tails, hists, lengths):
+        assert tail.shape == (n_bands, length)
+        energy = np.sum(tail.reshape((n_bands, -1, hbss)) ** 2, axis=-1)
+        expected = np.zeros_like(energy)
+        n = min(hist.shape[1], energy.shape[1])
+        expected[:, :n] = gains[:, None] ** 2 * hist[:, :n]
+        assert np.allclose(energy, expected, rtol=1e-6, atol=1e-12)
+
+
+def test_diffuse_tails_filters():
+    octave_bands = pra.acoustics.OctaveBandsFactory(fs=fs)
+    n_bands = octave_bands.n_bands
+    ones = np.ones(n_bands)
+    hists = [np.ones((n_bands, 100), dtype=np.float32)]
+    length = hbss * 100
+
+    # without filters, the tail of the single band gives the random sequence
+    seq = libroom.build_diffuse_tails(
+        [hists[0][:1]], [length], np.zeros((0, 0)), ones[:1], length, volume, c, fs, 7
+    )[0][0]
+    assert np.all(np.isin(np.sign(seq), [-1, 0, 1]))
+
+    # with a single bin, the bands are the filtered sequence up to a scale
+    tails = libroom.build_diffuse_tails(
+        [hists[0][:, :1]], [length], octave_bands.filters.T, ones, length, volume, c, fs, 7
+    )[0]
+    for b in range(n_bands):
+        ref = fftconvolve(seq, octave_bands.filters[:, b], mode="same")
+        ref /= np.linalg.norm(ref)
+        assert np.allclose(tails[b], ref, atol=1e-10)
+
+
+def test_diffuse_tails_threads():
+    octave_bands = pra.acoustics.OctaveBandsFactory(fs=fs)
+    gains = np.sqrt(octave_bands.get_bw() / fs * 2.0)
+    hists = make_histograms(octave_bands.n_bands, 6)
+    lengths = [hbss * 200] * 6
+
+    args = (hists, lengths, octave_bands.filters.T, gains, hbss, volume, c, fs, 42)
+    tails_1 = libroom.build_diffuse_tails(*args, n_threads=1)
+    tails_4 = libroom.build_diffuse_tails(*args, n_threads=4)
+    for t1, t4 in zip(tails_1, tails_4):
+        assert np.array_equal(t1, t4)
+
+    # another seed gives other tails
+    other = libroom.build_diffuse_tails(*args[:-1], 43)
+    assert not np.array_equal(other[0], tails_1[0])
+
+
+def test_diffuse_tails_room():
+    # the responses follow the numpy random generator
+    rirs = []
+    for i in range(2):
+        np.random.seed(0)
+        room = pra.ShoeBox(
+            [6.0, 5.0, 3.0],
+            fs=fs,
+            materials=pra.Material(energy_absorption="hard_surface", scattering=0.1),
+            max_order=3,
+            ray_tracing=True,
+        )
+        room.set_ray_tracing(n_rays=1000)
+        room.add_source([2.0, 3.0, 1.5])
+        room.add_microphone_array(np.array([[4.0, 1.0, 1.2], [1.0, 4.0, 2.0]]).T)
+        room.compute_rir()
+        rirs.append(room.rir)
+
+    for m in range(2):
+        assert np.array_equal(rirs[0][m][0], rirs[1][m][0])
+
+
+if __name__ == "__main__":
+    test_diffuse_tails_energy()
+    test_diffuse_tails_filters()
+    test_diffuse_tails_threads()
+    test_diffuse_tails_room()
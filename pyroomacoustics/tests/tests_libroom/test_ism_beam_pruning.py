@@ -0,0 +1,50 @@
+"""
+The image source model of polygonal rooms can skip the walls that are outside
+the beam of an image source. This test checks that the image sources found are
+the same with and without the pruning.
+"""
+import numpy as np
+import pyroomacoustics as pra
+
+corners = np.array([[0.0, 0.0], [6.0, 0.0], [6.0, 2.0], [2.0, 2.0], [2.0, 5.0], [0.0, 5.0]]).T
+source = [5.0, 1.5, 1.5]
+mics = np.array([[1.0, 4.0, 1.2], [5.0, 1.0, 1.2], [1.5, 1.0, 2.0]]).T
+
+
+def run_ism(room, beam_pruning):
+    room.set_image_source_options(beam_pruning=beam_pruning)
+    room.image_source_model()
+    return room.sources[0], room.visibility[0]
+
+
+def check_room(room):
+    room.add_source(source[: room.dim])
+    room.add_microphone_array(mics[: room.dim])
+
+    src, vis = run_ism(room, False)
+    src_beam, vis_beam = run_ism(room, True)
+
+    assert np.array_equal(src_beam.images, src.images)
+    assert np.array_equal(src_beam.damping, src.damping)
+    assert np.array_equal(src_beam.orders, src.orders)
+    assert np.array_equal(vis_beam, vis)
+
+
+def test_ism_beam_pruning_2d():
+    room = pra.Room.from_corners(
+        corners, fs=16000, materials=pra.Material(energy_absorption=0.2), max_order=8
+    )
+    check_room(room)
+
+
+def test_ism_beam_pruning_3d():
+    room = pra.Room.from_corners(
+        corners, fs=16000, materials=pra.Material(energy_absorption=0.2), max_order=5
+    )
+    room.extrude(3.0, materials=pra.Material(energy_absorption=0.2))
+    check_room(room)
+
+
+if __name__ == "__main__":
+    test_ism_beam_pruning_2d()
+    test_ism_beam_pruning_3d()
@@ -0,0 +1,69 @@
+"""
+The image source model can be limited to the image sources within some
+distance of the microphones. This test checks that the image sources found
+are the ones of the unlimited model that are close enough to a microphone
+that sees them.
+"""
+import numpy as np
+import pyroomacoustics as pra
+
+# a U shaped room, the source and the first microphone are in distinct arms
+corners = np.array(
+    [[0.0, 0.0], [7.0, 0.0], [7.0, 5.0], [5.0, 5.0], [5.0, 2.0], [2.0, 2.0], [2.0, 5.0], [0.0, 5.0]]
+).T
+source = [6.0, 4.0, 1.5]
+mics = np.array([[1.0, 4.0, 1.2], [3.5, 1.0, 1.2]]).T
+max_distance = 15.0
+
+
+def run_ism(room, max_distance):
+    room.set_image_source_options(max_distance=max_distance)
+    room.image_source_model()
+    return room.sources[0], room.visibility[0]
+
+
+def check_room(room):
+    room.add_source(source[: room.dim])
+    room.add_microphone_array(mics[: room.dim])
+
+    src, vis = run_ism(room, None)
+    dist = np.linalg.norm(src.images[:, None, :] - mics[: room.dim, :, None], axis=0)
+    keep = np.any((dist <= max_distance) & (vis > 0), axis=0)
+
+    src_lim, vis_lim = run_ism(room, max_distance)
+    assert 0 < np.sum(keep) < src.images.shape[1]
+    assert src_lim.images.shape[1] == np.sum(keep)
+    assert np.array_equal(src_lim.images, src.images[:, keep])
+    assert np.array_equal(src_lim.damping, src.damping[:, keep])
+    assert np.array_equal(vis_lim, vis[:, keep])
+
+
+def test_ism_max_distance_2d():
+    room = pra.Room.from_corners(
+        corners, fs=16000, materials=pra.Material(energy_absorption=0.2), max_order=6
+    )
+    check_room(room)
+
+
+def test_ism_max_distance_3d():
+    room = pra.Room.from_corners(
+        corners, fs=16000, materials=pra.Material(energy_absorption=0.2), max_order=6
+    )
+    room.extrude(3.0, materials=pra.Material(energy_absorption=0.2))
+    check_room(room)
+
+
+def test_ism_max_distance_shoebox():
+    room = pra.ShoeBox(
+        [7.0, 5.0, 3.0],
+        fs=16000,
+        materials=pra.Material(energy_absorption=0.2),
+        max_order=20,
+    )
+    check_room(room)
+
+
+if __name__ == "__main__":
+    test_ism_max_distance_2d()
+    test_ism_max_distance_3d()
+    test_ism_max_distance_shoebox()
@@ -0,0 +1,55 @@
+"""
+The image sources of polygonal rooms are searched without recursion, on one
+or several threads. This test checks that the image sources found are the
+same, in the same order, as with a single thread, also for a deep search in
+a 2D room.
+"""
+import numpy as np
+import pyroomacoustics as pra
+
+# an L shaped room, so that some image sources are not visible
+corners = np.array([[0.0, 0.0], [6.0, 0.0], [6.0, 2.0], [2.0, 2.0], [2.0, 5.0], [0.0, 5.0]]).T
+source = [5.0, 1.5, 1.5]
+mics = np.array([[1.0, 4.0, 1.2], [5.0, 1.0, 1.2]]).T
+
+
+def run_ism(dim, max_order, n_threads):
+    room = pra.Room.from_corners(
+        corners,
+        fs=16000,
+        materials=pra.Material(energy_absorption=0.2),
+        max_order=max_order,
+    )
+    if dim == 3:
+        room.extrude(3.0, materials=pra.Material(energy_absorption=0.2))
+    room.add_source(source[:dim])
+    room.add_microphone_array(mics[:dim])
+    room.set_image_source_options(n_threads=n_threads)
+    room.image_source_model()
+
+    return room.sources[0], room.visibility[0]
+
+
+def check_threads(dim, max_order):
+    src_ref, vis_ref = run_ism(dim, max_order, 1)
+    assert np.max(src_ref.orders) == max_order
+
+    for n_threads in [2, 4]:
+        src, vis = run_ism(dim, max_order, n_threads)
+        assert np.array_equal(src.images, src_ref.images)
+        assert np.array_equal(src.damping, src_ref.damping)
+        assert np.array_equal(src.walls, src_ref.walls)
+        assert np.array_equal(vis, vis_ref)
+
+
+def test_ism_threads_2d():
+    check_threads(2, 10)
+
+
+def test_ism_threads_3d():
+    check_threads(3, 5)
+
+
+if __name__ == "__main__":
+    test_ism_threads_2d()
+    test_ism_threads_3d()
@@ -0,0 +1,75 @@
+"""
+The wall intersections of polygonal rooms are accelerated with a bounding
+volume hierarchy. This test compares the result of ``next_wall_hit`` with a
+linear scan over all the walls for a room with many walls.
+"""
+import numpy as np
+import pyroomacoustics as pra
+
+
+def star_room(n_points, dim):
+    # a star shaped (i.e. non-convex) room with 2 * n_points vertical walls
+    angles = np.arange(2 * n_points) * np.pi / n_points
+    radius = np.where(np.arange(2 * n_points) % 2 == 0, 8.0, 6.0)
+    corners = np.array([10 + radius * np.cos(angles), 10 + radius * np.sin(angles)])
+
+    room = pra.Room.from_corners(corners, fs=16000, max_order=1)
+    if dim == 3:
+        room.extrude(3.0)
+
+    return room
+
+
+def linear_scan(walls, start, end):
+    hit_dist = np.inf
+    next_wall = -1
+    hit = np.zeros(start.shape[0], dtype=np.float32)
+
+    for i, wall in enumerate(walls):
+        if wall.intersection(start, end, hit) > -1:
+            dist = np.linalg.norm(hit - start)
+            if pra.libroom.get_eps() < dist < hit_dist:
+                hit_dist = dist
+                next_wall = i
+
+    return next_wall, hit_dist
+
+
+def run_next_wall_hit(dim):
+    np.random.seed(0)
+
+    room = star_room(40, dim)
+    engine = room.room_engine
+    walls = engine.walls
+
+    n_tested = 0
+    while n_tested < 100:
+        start = np.random.uniform(4.0, 16.0, size=dim)
+        if dim == 3:
+            start[2] = np.random.uniform(0.5, 2.5)
+        if not engine.contains(start):
+            continue
+
+        direction = np.random.randn(dim)
+        end = start + engine.max_dist * direction / np.linalg.norm(direction)
+
+        _, wall_idx, dist = engine.next_wall_hit(start, end, False)
+        wall_exp, dist_exp = linear_scan(walls, start, end)
+
+        assert wall_idx == wall_exp
+        assert np.allclose(dist, dist_exp)
+
+        n_tested += 1
+
+
+def test_next_wall_hit_bvh_2d():
+    run_next_wall_hit(2)
+
+
+def test_next_wall_hit_bvh_3d():
+    run_next_wall_hit(3)
+
+
+if __name__ == "__main__":
+    test_next_wall_hit_bvh_2d()
+    test_next_wall_hit_bvh_3d()
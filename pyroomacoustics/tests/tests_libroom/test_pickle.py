@@ -0,0 +1,134 @@
+"""
+The engine objects can be pickled. This test checks that the rooms, walls,
+microphones and histograms are the same after a round trip, with and without
+the results of the simulation.
+"""
+import pickle
+
+import numpy as np
+import pyroomacoustics as pra
+from pyroomacoustics import libroom
+
+corners = np.array([[0.0, 0.0], [6.0, 0.0], [6.0, 2.0], [2.0, 2.0], [2.0, 5.0], [0.0, 5.0]]).T
+source = np.array([5.0, 1.5, 1.5])
+mics = np.array([[1.0, 4.0, 1.2], [5.0, 1.0, 1.2]]).T
+
+
+def make_room(dim, shoebox=False):
+    if shoebox:
+        room = pra.ShoeBox(
+            [6.0, 5.0, 3.0][:dim],
+            fs=16000,
+            materials=pra.Material(energy_absorption=0.2, scattering=0.1),
+            max_order=4,
+            ray_tracing=True,
+        )
+    else:
+        room = pra.Room.from_corners(
+            corners,
+            fs=16000,
+            materials=pra.Material(energy_absorption=0.2, scattering=0.1),
+            max_order=3,
+            ray_tracing=True,
+        )
+        if dim == 3:
+            room.extrude(3.0, materials=pra.Material(energy_absorption=0.2, scattering=0.1))
+    room.set_ray_tracing(n_rays=1000)
+    room.add_source(source[:dim])
+    room.add_microphone_array(mics[:dim])
+    return room
+
+
+def check_walls(walls, walls_ref):
+    assert len(walls) == len(walls_ref)
+    for wall, ref in zip(walls, walls_ref):
+        assert wall.name == ref.name
+        assert np.array_equal(wall.corners, ref.corners)
+        assert np.array_equal(wall.absorption, ref.absorption)
+        assert np.array_equal(wall.scatter, ref.scatter)
+        assert np.array_equal(wall.normal, ref.normal)
+
+
+def check_pickle(dim, shoebox):
+    room = make_room(dim, shoebox)
+    room.room_engine.ism_beam_pruning = True
+    room.image_source_model()
+    room.room_engine.image_source_model(room.sources[0].position)
+    room.room_engine.ray_tracing(1000, room.sources[0].position)
+    engine = room.room_engine
+
+    copy = pickle.loads(pickle.dumps(engine))
+    assert copy.ism_beam_pruning
+    check_walls(copy.walls, engine.walls)
+    for attr in ["sources", "orders", "gen_walls", "attenuations", "visible_mics"]:
+        assert np.array_equal(getattr(copy, attr), getattr(engine, attr))
+    for mic, ref in zip(copy.microphones, engine.microphones):
+        assert np.array_equal(mic.loc, ref.loc)
+        assert np.array_equal(mic.histograms[0].get_hist(), ref.histograms[0].get_hist())
+    assert copy.to_bytes() == engine.to_bytes()
+
+    # without the results, the copy finds the same image sources again
+    empty = type(engine).from_bytes(engine.to_bytes(results=False))
+    assert empty.sources.shape[1] == 0
+    assert np.all(empty.microphones[0].histograms[0].get_hist() == 0)
+    empty.image_source_model(room.sources[0].position)
+    assert np.array_equal(empty.sources, engine.sources)
+    assert np.array_equal(empty.visible_mics, engine.visible_mics)
+
+    # the python room goes through the engine
+    room_copy = pickle.loads(pickle.dumps(room))
+    assert np.array_equal(room_copy.sources[0].images, room.sources[0].images)
+    check_walls(room_copy.walls, room.walls)
+
+
+def test_pickle_2d():
+    check_pickle(2, False)
+    check_pickle(2, True)
+
+
+def test_pickle_3d():
+    check_pickle(3, False)
+    check_pickle(3, True)
+
+
+def test_pickle_parts():
+    wall = libroom.Wall(
+        np.array([[0.0, 1.0, 1.0, 0.0], [0.0, 0.0, 1.0, 1.0], [0.0, 0.0, 0.0, 0.0]]),
+        np.array([0.1, 0.2]),
+        np.array([0.3, 0.4]),
+        "floor",
+    )
+    check_walls([pickle.loads(pickle.dumps(wall))], [wall])
+
+    mic = libroom.Microphone(np.array([1.0, 2.0, 3.0]), 2, 0.004 * 343, 343.0)
+    mic.histograms[0].log(1, 5, 0.5)
+    copy = pickle.loads(pickle.dumps(mic))
+    assert np.array_equal(copy.loc, mic.loc)
+    assert np.array_equal(copy.histograms[0].get_hist(), mic.histograms[0].get_hist())
+    assert np.array_equal(copy.histograms[0].get_counts(), mic.histograms[0].get_counts())
+
+    hist = pickle.loads(pickle.dumps(mic.histograms[0]))
+    assert hist.bin(1, 5) == 0.5
+
+    try:
+        libroom.Room.from_bytes(wall.to_bytes())
+    except RuntimeError:
+        pass
+    else:
+        assert False, "a wall should not be read as a room"
+
+    # the data written with the other byte order is rejected
+    data = bytearray(wall.to_bytes())
+    data[4], data[5] = data[5], data[4]
+    try:
+        libroom.Wall.from_bytes(bytes(data))
+    except RuntimeError:
+        pass
+    else:
+        assert False, "the byte order should be checked"
+
+
+if __name__ == "__main__":
+    test_pickle_2d()
+    test_pickle_3d()
+    test_pickle_parts()
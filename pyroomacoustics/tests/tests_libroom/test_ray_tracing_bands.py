@@ -0,0 +1,44 @@
+"""
+The energies of the rays are stored in fixed size arrays for some numbers of
+frequency bands. This test checks that, when all the bands have the same
+coefficients, every band of the histograms is the same as the single band one.
+"""
+import numpy as np
+import pyroomacoustics as pra
+
+walls_corners = [
+    np.array([[0, 3, 3, 0], [0, 0, 0, 0], [0, 0, 2, 2]]),
+    np.array([[0, 0, 3, 3], [4, 4, 4, 4], [0, 2, 2, 0]]),
+    np.array([[0, 0, 0, 0], [0, 4, 4, 0], [0, 0, 2, 2]]),
+    np.array([[3, 3, 3, 3], [0, 0, 4, 4], [0, 2, 2, 0]]),
+    np.array([[0, 3, 3, 0], [0, 0, 4, 4], [0, 0, 0, 0]]),
+    np.array([[0, 0, 3, 3], [0, 4, 4, 0], [2, 2, 2, 2]]),
+]
+
+
+def run_ray_tracing(n_bands):
+    walls = [
+        pra.wall_factory(c, [0.2] * n_bands, [0.1] * n_bands) for c in walls_corners
+    ]
+    room = pra.Room(walls, fs=16000)
+    room.add_source([1.0, 1.5, 1.0])
+    room.add_microphone([2.0, 3.0, 1.2])
+
+    room.room_engine.ray_tracing(2000, room.sources[0].position)
+
+    return room.room_engine.microphones[0].histograms[0].get_hist()
+
+
+def test_ray_tracing_bands():
+    hist_ref = run_ray_tracing(1)
+
+    for n_bands in [5, 7, 8, 16]:
+        hist = run_ray_tracing(n_bands)
+
+        assert hist.shape[0] == n_bands
+        for b in range(n_bands):
+            assert np.allclose(hist[b], hist_ref[0])
+
+
+if __name__ == "__main__":
+    test_ray_tracing_bands()
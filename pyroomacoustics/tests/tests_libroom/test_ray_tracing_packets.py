@@ -0,0 +1,44 @@
+"""
+Checks that tracing the rays by packets in shoebox rooms gives the same
+histograms as tracing them one by one (up to floating point rounding).
+"""
+import numpy as np
+import pyroomacoustics as pra
+
+rooms = [
+    ([6.0, 5.0, 3.0], [2.0, 3.0, 1.5], np.c_[[1.0, 1.0, 1.2], [4.5, 3.9, 2.0]]),
+    ([6.0, 5.0], [2.0, 3.0], np.c_[[1.0, 1.0], [4.5, 3.9]]),
+]
+
+
+def run_ray_tracing(room_dim, source, mics, ray_packet_size):
+    room = pra.ShoeBox(
+        room_dim,
+        fs=16000,
+        materials=pra.Material(energy_absorption=0.1, scattering=0.1),
+        max_order=2,
+        ray_tracing=True,
+        air_absorption=False,
+    )
+    room.add_source(source)
+    room.add_microphone_array(mics)
+    room.set_ray_tracing(n_rays=3000, ray_packet_size=ray_packet_size)
+    room.ray_tracing()
+
+    return [h[0][0] for h in room.rt_histograms]
+
+
+def test_ray_tracing_packets():
+    for room_dim, source, mics in rooms:
+        hist_ref = run_ray_tracing(room_dim, source, mics, 1)
+
+        for ray_packet_size in [4, 8, 16]:
+            hist = run_ray_tracing(room_dim, source, mics, ray_packet_size)
+
+            for h_ref, h in zip(hist_ref, hist):
+                n_bins = min(h_ref.shape[1], h.shape[1])
+                assert np.allclose(h_ref[:, :n_bins], h[:, :n_bins], rtol=1e-4)
+
+
+if __name__ == "__main__":
+    test_ray_tracing_packets()
@@ -0,0 +1,43 @@
+"""
+The receivers hit by the specular rays are found with a bounding volume
+hierarchy when there are many of them. This test checks that the histograms
+of a few receivers of a large grid are the same as when they are alone.
+"""
+import numpy as np
+import pyroomacoustics as pra
+
+room_dim = [6.0, 5.0, 3.0]
+source = [2.1, 3.3, 1.5]
+
+
+def run_ray_tracing(mics):
+    room = pra.ShoeBox(
+        room_dim,
+        fs=16000,
+        materials=pra.Material(energy_absorption=0.1, scattering=0.1),
+        max_order=2,
+        ray_tracing=True,
+        air_absorption=False,
+    )
+    room.add_source(source)
+    room.add_microphone_array(mics)
+    room.set_ray_tracing(n_rays=2000)
+    room.ray_tracing()
+
+    return [h[0][0] for h in room.rt_histograms]
+
+
+def test_ray_tracing_receivers():
+    x, y = np.meshgrid(np.linspace(0.5, 5.5, 6), np.linspace(0.5, 4.5, 6))
+    grid = np.array([x.ravel(), y.ravel(), 1.2 * np.ones(x.size)])
+
+    hist_grid = run_ray_tracing(grid)
+
+    for m in [0, 13, 35]:
+        hist = run_ray_tracing(grid[:, [m]])[0]
+        n_bins = min(hist.shape[1], hist_grid[m].shape[1])
+        assert np.allclose(hist[:, :n_bins], hist_grid[m][:, :n_bins])
+
+
+if __name__ == "__main__":
+    test_ray_tracing_receivers()
@@ -0,0 +1,41 @@
+"""
+In the reciprocal mode, the rays are traced from the microphones and the
+energy is collected around the sources. This test checks that the energy
+received is close to the one of the regular ray tracing.
+"""
+import numpy as np
+import pyroomacoustics as pra
+
+room_dim = [6.0, 5.0, 3.0]
+sources = [[1.0, 1.0, 1.5], [2.5, 4.0, 1.0], [5.0, 2.0, 2.0]]
+mic = [4.5, 3.5, 1.2]
+
+
+def run_ray_tracing(reciprocal):
+    room = pra.ShoeBox(
+        room_dim,
+        fs=16000,
+        materials=pra.Material(energy_absorption=0.2, scattering=0.1),
+        max_order=2,
+        ray_tracing=True,
+        air_absorption=False,
+    )
+    for src in sources:
+        room.add_source(src)
+    room.add_microphone(mic)
+    room.set_ray_tracing(n_rays=50000, reciprocal=reciprocal)
+    room.ray_tracing()
+
+    return [np.sum(h[0]) for h in room.rt_histograms[0]]
+
+
+def test_ray_tracing_reciprocal():
+    energy_ref = run_ray_tracing(False)
+    energy = run_ray_tracing(True)
+
+    assert len(energy) == len(sources)
+    assert np.allclose(energy, energy_ref, rtol=0.1)
+
+
+if __name__ == "__main__":
+    test_ray_tracing_reciprocal()
@@ -0,0 +1,40 @@
+"""
+The ray tracing of all the sources of a room is done in a single call to the
+engine that returns the histograms in one array. This test checks the shape
+of the array and that its content is the same as when the sources are traced
+one by one.
+"""
+import numpy as np
+import pyroomacoustics as pra
+
+room_dim = [6.0, 5.0, 3.0]
+sources = np.array([[1.0, 1.0, 1.5], [2.5, 4.0, 1.0], [5.0, 2.0, 2.0]]).T
+mics = np.array([[4.5, 3.5, 1.2], [2.0, 2.0, 1.0]]).T
+n_rays = 5000
+
+
+def test_ray_tracing_sources():
+    room = pra.ShoeBox(
+        room_dim,
+        fs=16000,
+        materials=pra.Material(energy_absorption=0.2, scattering=0.1),
+        max_order=2,
+        ray_tracing=True,
+        air_absorption=False,
+    )
+    room.add_microphone_array(mics)
+    room.set_ray_tracing(n_rays=n_rays)
+
+    hists = room.room_engine.ray_tracing_sources(n_rays, sources)
+    assert hists.shape[:3] == (sources.shape[1], mics.shape[1], 1)
+
+    for s in range(sources.shape[1]):
+        room.room_engine.ray_tracing(n_rays, sources[:, s])
+        for m in range(mics.shape[1]):
+            hist = room.room_engine.microphones[m].histograms[0].get_hist()
+            assert np.allclose(hists[s, m, :, : hist.shape[1]], hist)
+        room.room_engine.reset_mics()
+
+
+if __name__ == "__main__":
+    test_ray_tracing_sources()
@@ -0,0 +1,45 @@
+"""
+Checks that the multithreaded ray tracing gives the same histograms as the
+single threaded one (up to floating point rounding) and that the result is
+reproducible for a fixed number of threads.
+"""
+import numpy as np
+import pyroomacoustics as pra
+
+room_dim = [6.0, 5.0, 3.0]
+source = [2.0, 3.0, 1.5]
+mics = np.c_[[1.0, 1.0, 1.2], [4.5, 3.9, 2.0]]
+
+
+def run_ray_tracing(n_threads):
+    room = pra.ShoeBox(
+        room_dim,
+        fs=16000,
+        materials=pra.Material(energy_absorption=0.1, scattering=0.1),
+        max_order=2,
+        ray_tracing=True,
+        air_absorption=False,
+    )
+    room.add_source(source)
+    room.add_microphone_array(mics)
+    room.set_ray_tracing(n_rays=5000, n_threads=n_threads)
+    room.ray_tracing()
+
+    return [h[0][0] for h in room.rt_histograms]
+
+
+def test_ray_tracing_threads():
+    hist_ref = run_ray_tracing(1)
+
+    for n_threads in [2, 3, 8]:
+        hist_1 = run_ray_tracing(n_threads)
+        hist_2 = run_ray_tracing(n_threads)
+
+        for h_ref, h1, h2 in zip(hist_ref, hist_1, hist_2):
+            n_bins = min(h_ref.shape[1], h1.shape[1])
+            assert np.allclose(h_ref[:, :n_bins], h1[:, :n_bins], rtol=1e-4)
+            assert np.array_equal(h1, h2)
+
+
+if __name__ == "__main__":
+    test_ray_tracing_threads()
@@ -0,0 +1,83 @@
+"""
+The long running methods of the engine release the GIL so that distinct rooms
+can be simulated on several Python threads. This test checks that Python code
+runs while the engine traces the rays, and that the results are the same as
+when the rooms are simulated one after the other.
+"""
+import sys
+import threading
+from concurrent.futures import ThreadPoolExecutor
+
+import numpy as np
+import pyroomacoustics as pra
+
+corners = np.array([[0.0, 0.0], [6.0, 0.0], [6.0, 2.0], [2.0, 2.0], [2.0, 5.0], [0.0, 5.0]]).T
+mics = np.array([[1.0, 4.0, 1.2], [5.0, 1.0, 1.2]]).T
+sources = np.array([[5.0, 1.5, 1.5], [1.0, 1.0, 1.0], [1.5, 4.0, 2.0], [4.0, 0.5, 2.5]])
+
+
+def make_room(source):
+    room = pra.Room.from_corners(
+        corners,
+        fs=16000,
+        materials=pra.Material(energy_absorption=0.2, scattering=0.1),
+        max_order=3,
+        ray_tracing=True,
+    )
+    room.extrude(3.0, materials=pra.Material(energy_absorption=0.2, scattering=0.1))
+    room.set_ray_tracing(n_rays=1000)
+    room.add_source(source)
+    room.add_microphone_array(mics)
+    return room
+
+
+def simulate(source):
+    room = make_room(source)
+    room.image_source_model()
+    room.ray_tracing()
+    return room.sources[0].images, room.visibility[0], room.rt_histograms[0][0][0]
+
+
+def test_release_gil_concurrent():
+    room = make_room(sources[0])
+    started = threading.Event()
+    counter = [0]
+
+    def trace():
+        started.set()
+        before = counter[0]
+        room.room_engine.ray_tracing(20000, room.sources[0].position)
+        return before, counter[0]
+
+    # with a long switch interval, the interpreter does not preempt the
+    # tracing thread, so the main thread only counts if the engine releases
+    # the GIL
+    interval = sys.getswitchinterval()
+    sys.setswitchinterval(1.0)
+    try:
+        with ThreadPoolExecutor(max_workers=1) as executor:
+            future = executor.submit(trace)
+            started.wait()
+            while not future.done():
+                counter[0] += 1
+            before, after = future.result()
+    finally:
+        sys.setswitchinterval(interval)
+
+    assert after > before
+
+
+def test_release_gil_results():
+    expected = [simulate(source) for source in sources]
+
+    with ThreadPoolExecutor(max_workers=len(sources)) as executor:
+        results = list(executor.map(simulate, sources))
+
+    for res, ref in zip(results, expected):
+        for a, b in zip(res, ref):
+            assert np.array_equal(a, b)
+
+
+if __name__ == "__main__":
+    test_release_gil_concurrent()
+    test_release_gil_results()
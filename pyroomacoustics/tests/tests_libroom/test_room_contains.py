@@ -0,0 +1,44 @@
+"""
+The walls of the rooms are tested against line segments on a packed copy of
+their geometry. This test checks ``Room.contains`` in a non-convex room
+against the point in polygon test of its floor plan.
+"""
+import numpy as np
+import pyroomacoustics as pra
+
+
+def star_corners(n_points):
+    angles = np.arange(2 * n_points) * np.pi / n_points
+    radius = np.where(np.arange(2 * n_points) % 2 == 0, 8.0, 6.0)
+    return np.array([10 + radius * np.cos(angles), 10 + radius * np.sin(angles)])
+
+
+def run_contains(dim):
+    np.random.seed(1)
+
+    corners = star_corners(30)
+    room = pra.Room.from_corners(corners, fs=16000, max_order=1)
+    if dim == 3:
+        room.extrude(3.0)
+
+    for n in range(200):
+        point = np.random.uniform(1.0, 19.0, size=dim)
+        inside = pra.libroom.is_inside_2d_polygon(point[:2], corners) == 0
+        if dim == 3:
+            point[2] = np.random.uniform(-1.0, 4.0)
+            inside = inside and 0.0 < point[2] < 3.0
+
+        assert room.room_engine.contains(point) == inside
+
+
+def test_room_contains_2d():
+    run_contains(2)
+
+
+def test_room_contains_3d():
+    run_contains(3)
+
+
+if __name__ == "__main__":
+    test_room_contains_2d()
+    test_room_contains_3d()
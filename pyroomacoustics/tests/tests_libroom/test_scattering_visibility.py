@@ -0,0 +1,56 @@
+"""
+The visibility of the receivers from the walls can be precomputed on patches
+of the walls to skip most of the ray casts of the scattered rays. This test
+checks that the histograms of a non-convex room with scattering are the same
+with and without the visibility table, for several sizes of patches.
+"""
+import numpy as np
+import pyroomacoustics as pra
+
+# an L shaped room, so that some receivers are hidden from some walls
+corners = np.array([[0.0, 0.0], [6.0, 0.0], [6.0, 2.0], [2.0, 2.0], [2.0, 5.0], [0.0, 5.0]]).T
+source = [5.0, 1.0, 1.5]
+mics = np.array([[1.0, 4.0, 1.2], [5.0, 1.5, 1.2], [1.5, 1.0, 2.0]]).T
+
+
+def run_ray_tracing(dim, patch_size):
+    room = pra.Room.from_corners(
+        corners,
+        fs=16000,
+        materials=pra.Material(energy_absorption=0.1, scattering=0.3),
+        max_order=1,
+        ray_tracing=True,
+        air_absorption=False,
+    )
+    if dim == 3:
+        room.extrude(
+            3.0, materials=pra.Material(energy_absorption=0.1, scattering=0.3)
+        )
+    room.add_source(source[:dim])
+    room.add_microphone_array(mics[:dim])
+    room.set_ray_tracing(n_rays=5000, visibility_patch_size=patch_size)
+    room.ray_tracing()
+
+    return [room.rt_histograms[m][0][0] for m in range(room.mic_array.M)]
+
+
+def check_visibility(dim):
+    hists_ref = run_ray_tracing(dim, None)
+    for patch_size in [1.0, 0.5, 0.25]:
+        hists = run_ray_tracing(dim, patch_size)
+        for hist, hist_ref in zip(hists, hists_ref):
+            assert hist.shape == hist_ref.shape
+            assert np.allclose(hist, hist_ref)
+
+
+def test_scattering_visibility_2d():
+    check_visibility(2)
+
+
+def test_scattering_visibility_3d():
+    check_visibility(3)
+
+
+if __name__ == "__main__":
+    test_scattering_visibility_2d()
+    test_scattering_visibility_3d()
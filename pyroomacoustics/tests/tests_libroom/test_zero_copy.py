@@ -0,0 +1,66 @@
+"""
+The histograms of all the sources and the image sources are passed to python
+without copy. This test checks that the histogram tensor stays valid after the
+room is deleted, that the histograms of the microphones are copies, and that
+the image sources are moved out of the engine.
+"""
+import numpy as np
+import pyroomacoustics as pra
+
+
+def make_room():
+    room = pra.ShoeBox(
+        [6.0, 5.0, 3.0],
+        fs=16000,
+        materials=pra.Material(energy_absorption=0.2, scattering=0.1),
+        max_order=3,
+        ray_tracing=True,
+        air_absorption=False,
+    )
+    room.add_source([2.1, 3.3, 1.5])
+    room.add_microphone([4.5, 3.5, 1.2])
+    room.set_ray_tracing(n_rays=2000)
+    return room
+
+
+def test_histogram_copy():
+    room = make_room()
+    engine = room.room_engine
+    engine.ray_tracing(2000, room.sources[0].position)
+
+    # the histograms of the microphones are copies owned by python
+    hist = engine.microphones[0].histograms[0].get_hist()
+    assert hist.flags.owndata
+
+    energy = np.sum(hist)
+    assert energy > 0
+
+    engine.reset_mics()
+    assert np.sum(hist) == energy
+    assert np.sum(engine.microphones[0].histograms[0].get_hist()) == 0
+
+    # the tensor of all the sources is passed without copy
+    hists = engine.ray_tracing_sources(2000, room.sources[0].position[:, None])
+    assert not hists.flags.owndata
+    energy = np.sum(hists)
+    del room, engine
+    assert np.sum(hists) == energy
+
+
+def test_release_image_sources():
+    room = make_room()
+    n_images = room.room_engine.image_source_model(room.sources[0].position)
+
+    images = room.room_engine.release_image_sources()
+    assert images["sources"].shape == (3, n_images)
+    assert images["attenuations"].shape[1] == n_images
+    assert images["visible_mics"].shape == (1, n_images)
+    assert images["sources"].flags.writeable
+
+    # the engine does not hold the image sources anymore
+    assert room.room_engine.sources.shape[1] == 0
+
+
+if __name__ == "__main__":
+    test_histogram_copy()
+    test_release_image_sources()
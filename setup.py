@@ -47,10 +47,19 @@ libroom_files = [
         "room.cpp",
         "wall.hpp",
         "wall.cpp",
+        "bvh.hpp",
+        "wall_cache.hpp",
+        "visibility.hpp",
+        "beam.hpp",
+        "rir_builder.hpp",
+        "diffuse_tail.hpp",
+        "batch.hpp",
+        "serialize.hpp",
         "microphone.hpp",
         "geometry.hpp",
         "geometry.cpp",
         "common.hpp",
+        "parallel.hpp",
         "libroom.cpp",
     ]
 ]